@@ -7,97 +7,1488 @@
 
 #include <limits>
 #include <cerrno>
+#include <cstring>
+#include <cctype>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 #include "ArgumentParser.h"
 
+namespace
+{
+    // Snapshot layout (all integers are native-endian uint32_t, all offsets
+    // are relative to the start of the blob):
+    //
+    //   header  magic "APS1", total size, argument count, verb offset, verb length
+    //   index   count x (key offset, key length, value offset, value length),
+    //           sorted by key
+    //   pool    NUL-terminated verb, keys and values
+    char const        snapshot_magic[4]    = { 'A', 'P', 'S', '1' };
+    std::size_t const snapshot_header_size = 20;
+    std::size_t const snapshot_entry_size  = 16;
+
+    void write_u32(std::vector<char> & blob, std::size_t offset, std::uint32_t value)
+    {
+        std::memcpy(&blob[offset], &value, sizeof(value));
+    }
+
+    std::uint32_t append_string(std::vector<char> & blob, std::string const & value)
+    {
+        auto offset = static_cast<std::uint32_t>(blob.size());
+        blob.insert(blob.end(), value.begin(), value.end());
+        blob.push_back('\0');
+        return offset;
+    }
+
+    // Three-way comparison of (name, length) pairs. Names are short, so a
+    // plain loop beats a call to memcmp.
+    int compare_name(char const * a, std::size_t a_length, char const * b, std::size_t b_length)
+    {
+        auto common = std::min(a_length, b_length);
+        for(std::size_t i = 0; i < common; ++i) {
+            if(a[i] != b[i]) {
+                return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]) ? -1 : 1;
+            }
+        }
+        return (a_length < b_length) ? -1 : (a_length > b_length ? 1 : 0);
+    }
+
+    // Levenshtein distance between pattern and text, using Myers'
+    // bit-parallel algorithm (as formulated by Hyyro). 'match' holds, for
+    // each character, the bit mask of its positions in the pattern, which
+    // must be 1 to 64 characters long. Gives up and returns limit + 1 once
+    // the distance is known to exceed limit.
+    std::size_t edit_distance(std::uint64_t const * match, std::size_t pattern_length,
+                              char const * text, std::size_t text_length, std::size_t limit)
+    {
+        std::uint64_t last = std::uint64_t(1) << (pattern_length - 1);
+        std::uint64_t positive = ~std::uint64_t(0);
+        std::uint64_t negative = 0;
+        std::size_t score = pattern_length;
+
+        for(std::size_t i = 0; i < text_length; ++i) {
+            auto equal = match[static_cast<unsigned char>(text[i])];
+            auto vertical = equal | negative;
+            auto horizontal = (((equal & positive) + positive) ^ positive) | equal;
+            auto horizontal_positive = negative | ~(horizontal | positive);
+            auto horizontal_negative = positive & horizontal;
+
+            if(horizontal_positive & last) {
+                ++score;
+            } else if(horizontal_negative & last) {
+                --score;
+            }
+
+            // Each remaining text character can lower the score by one at most
+            if(score > limit + (text_length - i - 1)) {
+                return limit + 1;
+            }
+
+            horizontal_positive = (horizontal_positive << 1) | 1;
+            horizontal_negative <<= 1;
+            positive = horizontal_negative | ~(vertical | horizontal_positive);
+            negative = horizontal_positive & vertical;
+        }
+        return score;
+    }
+
+    // Hash of a symbol from ArgumentSymbolTable (Fibonacci hashing)
+    std::uint32_t symbol_hash(std::uint32_t symbol)
+    {
+        return symbol * 2654435769U;
+    }
+
+    // Seeded rehash of a name hash (splitmix64 finalizer)
+    std::size_t displace(std::size_t hash, std::size_t seed)
+    {
+        std::uint64_t value = static_cast<std::uint64_t>(hash) + seed * 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return static_cast<std::size_t>(value ^ (value >> 31));
+    }
+
+    std::uint64_t const byte_ones = 0x0101010101010101ULL;
+    std::uint64_t const byte_high = 0x8080808080808080ULL;
+
+    // Sets high bits in word's bytes if any byte is not ASCII or, with
+    // reject_control, is below 0x20 or equal to 0x7F. For ASCII bytes,
+    // (b + 1) & 0x7F maps exactly those to values below 0x21, which the
+    // usual "has less" bit trick detects. Any byte order works.
+    std::uint64_t flag_bytes(std::uint64_t word, bool reject_control)
+    {
+        auto flags = word;
+        if(reject_control) {
+            auto shifted = (word + byte_ones) & ~byte_high;
+            flags |= (shifted - byte_ones * 0x21) & ~shifted;
+        }
+        return flags & byte_high;
+    }
+
+    // The one to seven bytes at tail, as a word padded with spaces (which
+    // pass all checks). Overlapping loads cover every byte without a loop,
+    // so short tokens do not cost a branch misprediction per byte.
+    std::uint64_t tail_word(unsigned char const * tail, std::size_t count)
+    {
+        if(count >= 4) {
+            std::uint32_t low;
+            std::uint32_t high;
+            std::memcpy(&low, tail, sizeof(low));
+            std::memcpy(&high, tail + count - 4, sizeof(high));
+            return low | (static_cast<std::uint64_t>(high) << 32);
+        }
+        return ((byte_ones * ' ') << 24) | tail[0] | (tail[count / 2] << 8) | (tail[count - 1] << 16);
+    }
+
+    // Length of the longest valid UTF-8 prefix of token[0, length). With
+    // reject_control, control characters (C0, DEL and C1) also end it.
+    // Runs of ASCII are checked a word at a time.
+    std::size_t valid_utf8_prefix(char const * token, std::size_t length, bool reject_control)
+    {
+        auto bytes = reinterpret_cast<unsigned char const *>(token);
+        std::size_t i = 0;
+
+        while(i < length) {
+            // Four words per step, without early exits
+            while(length - i >= 4 * sizeof(std::uint64_t)) {
+                std::uint64_t word0, word1, word2, word3;
+                std::memcpy(&word0, bytes + i, sizeof(word0));
+                std::memcpy(&word1, bytes + i + 8, sizeof(word1));
+                std::memcpy(&word2, bytes + i + 16, sizeof(word2));
+                std::memcpy(&word3, bytes + i + 24, sizeof(word3));
+                if((flag_bytes(word0, reject_control) | flag_bytes(word1, reject_control) |
+                    flag_bytes(word2, reject_control) | flag_bytes(word3, reject_control)) != 0) {
+                    break;
+                }
+                i += 4 * sizeof(std::uint64_t);
+            }
+
+            // Then one word, or the remaining one to seven bytes
+            std::uint64_t word;
+            auto count = std::min(length - i, sizeof(word));
+            if(count == sizeof(word)) {
+                std::memcpy(&word, bytes + i, sizeof(word));
+            } else {
+                word = tail_word(bytes + i, count);
+            }
+            if(flag_bytes(word, reject_control) == 0) {
+                i += count;
+                continue;
+            }
+
+            // One character at a time until the next ASCII word
+            auto c = bytes[i];
+            if(c < 0x80) {
+                if(reject_control && (c < 0x20 || c == 0x7F)) {
+                    return i;
+                }
+                ++i;
+                continue;
+            }
+
+            std::size_t continuation;
+            unsigned char low = 0x80;
+            unsigned char high_bound = 0xBF;
+            if(c >= 0xC2 && c <= 0xDF) {
+                continuation = 1;
+                if(reject_control && c == 0xC2) {
+                    low = 0xA0;
+                }
+            } else if(c >= 0xE0 && c <= 0xEF) {
+                continuation = 2;
+                if(c == 0xE0) {
+                    low = 0xA0;         // Overlong
+                } else if(c == 0xED) {
+                    high_bound = 0x9F;  // Surrogates
+                }
+            } else if(c >= 0xF0 && c <= 0xF4) {
+                continuation = 3;
+                if(c == 0xF0) {
+                    low = 0x90;         // Overlong
+                } else if(c == 0xF4) {
+                    high_bound = 0x8F;  // Above U+10FFFF
+                }
+            } else {
+                return i;
+            }
+
+            if(length - i <= continuation || bytes[i + 1] < low || bytes[i + 1] > high_bound) {
+                return i;
+            }
+            for(std::size_t k = 2; k <= continuation; ++k) {
+                if((bytes[i + k] & 0xC0) != 0x80) {
+                    return i;
+                }
+            }
+            i += continuation + 1;
+        }
+        return length;
+    }
+
+    // Same rule as ArgumentParser::is_switch(), without building a string
+    bool is_option_token(char const * token)
+    {
+        return token[0] == '-' && token[1] != '\0';
+    }
+}
+
+std::uint32_t const ArgumentSymbolTable::no_symbol;
+
+ArgumentSymbolTable::ArgumentSymbolTable()
+: _frozen(false)
+{ }
+
+std::uint32_t ArgumentSymbolTable::intern(char const * name, std::size_t length)
+{
+    return intern(name, length, ArgumentTable::hash(name, length));
+}
+
+std::uint32_t ArgumentSymbolTable::intern(char const * name, std::size_t length, std::size_t hash)
+{
+    std::uint32_t symbol;
+    if(_frozen.load(std::memory_order_acquire)) {
+        return find_unlocked(name, length, hash, symbol) ? symbol : no_symbol;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Frozen while waiting for the lock
+    if(_frozen.load(std::memory_order_relaxed)) {
+        return find_unlocked(name, length, hash, symbol) ? symbol : no_symbol;
+    }
+
+    // Keep load factor at or below 1/2
+    if(2 * (_name.size() + 1) > _slot.size()) {
+        grow();
+    }
+
+    auto & slot = _slot[probe(name, length, hash)];
+    if(slot == 0) {
+        _name.push_back(Name{static_cast<std::uint32_t>(_pool.size()), static_cast<std::uint32_t>(length), hash});
+        _pool.insert(_pool.end(), name, name + length);
+        slot = static_cast<std::uint32_t>(_name.size());
+    }
+    return slot - 1;
+}
+
+std::uint32_t ArgumentSymbolTable::intern(std::string const & name)
+{
+    return intern(name.data(), name.length());
+}
+
+void ArgumentSymbolTable::intern_declared(ArgumentParser const & schema)
+{
+    for(auto const & name : schema.complete("")) {
+        intern(name);
+    }
+}
+
+void ArgumentSymbolTable::freeze()
+{
+    // Waits for any intern() in progress; none modifies the table afterwards
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frozen.store(true, std::memory_order_release);
+}
+
+bool ArgumentSymbolTable::frozen() const
+{
+    return _frozen.load(std::memory_order_acquire);
+}
+
+bool ArgumentSymbolTable::find(char const * name, std::size_t length, std::uint32_t & symbol) const
+{
+    return find(name, length, ArgumentTable::hash(name, length), symbol);
+}
+
+bool ArgumentSymbolTable::find(char const * name, std::size_t length, std::size_t hash, std::uint32_t & symbol) const
+{
+    if(_frozen.load(std::memory_order_acquire)) {
+        return find_unlocked(name, length, hash, symbol);
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    return find_unlocked(name, length, hash, symbol);
+}
+
+bool ArgumentSymbolTable::find_unlocked(char const * name, std::size_t length, std::size_t hash, std::uint32_t & symbol) const
+{
+    if(_slot.empty()) {
+        return false;
+    }
+    auto slot = _slot[probe(name, length, hash)];
+    if(slot == 0) {
+        return false;
+    }
+    symbol = slot - 1;
+    return true;
+}
+
+std::string ArgumentSymbolTable::name(std::uint32_t symbol) const
+{
+    if(_frozen.load(std::memory_order_acquire)) {
+        return std::string(_pool.data() + _name[symbol].offset, _name[symbol].length);
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::string(_pool.data() + _name[symbol].offset, _name[symbol].length);
+}
+
+std::size_t ArgumentSymbolTable::size() const
+{
+    if(_frozen.load(std::memory_order_acquire)) {
+        return _name.size();
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _name.size();
+}
+
+std::size_t ArgumentSymbolTable::probe(char const * name, std::size_t length, std::size_t hash) const
+{
+    // Returns the slot holding name, or the empty slot where it belongs
+    auto mask = _slot.size() - 1;
+    auto index = hash & mask;
+    while(_slot[index] != 0) {
+        auto const & entry = _name[_slot[index] - 1];
+        if(entry.hash == hash && compare_name(_pool.data() + entry.offset, entry.length, name, length) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void ArgumentSymbolTable::grow()
+{
+    _slot.assign(_slot.empty() ? 64 : 2 * _slot.size(), 0);
+
+    auto mask = _slot.size() - 1;
+    for(std::size_t symbol = 0; symbol < _name.size(); ++symbol) {
+        auto index = _name[symbol].hash & mask;
+        while(_slot[index] != 0) {
+            index = (index + 1) & mask;
+        }
+        _slot[index] = static_cast<std::uint32_t>(symbol + 1);
+    }
+}
+
+ArgumentTable::ArgumentTable()
+: _size(0)
+{ }
+
+ArgumentTable::ArgumentTable(ArgumentTable const & other)
+: _entry(other._entry),
+  _pool(other._pool),
+  _size(other._size),
+  _symbols(other._symbols)
+{
+    // Copies in the other pool move to the same offset in this one; the
+    // rest are borrowed, or empty and not pooled
+    repoint(other._pool.data());
+}
+
+ArgumentTable & ArgumentTable::operator=(ArgumentTable const & other)
+{
+    if(this != &other) {
+        ArgumentTable copied(other);
+        _entry.swap(copied._entry);
+        _pool.swap(copied._pool);
+        _size = copied._size;
+        _symbols.swap(copied._symbols);
+    }
+    return *this;
+}
+
+void ArgumentTable::set_symbol_table(std::shared_ptr<ArgumentSymbolTable> symbols)
+{
+    _entry.clear();
+    _pool.clear();
+    _size = 0;
+    _symbols = symbols;
+}
+
+void ArgumentTable::clear()
+{
+    if(_size == 0) {
+        return;
+    }
+    for(auto & entry : _entry) {
+        entry.value = nullptr;
+    }
+    _pool.clear();
+    _size = 0;
+}
+
+std::size_t ArgumentTable::size() const
+{
+    return _size;
+}
+
+bool ArgumentTable::insert(char const * name, std::size_t length, char const * value, std::size_t value_length,
+                           Storage storage)
+{
+    return insert(name, length, hash(name, length), value, value_length, storage);
+}
+
+bool ArgumentTable::insert(char const * name, std::size_t length, std::size_t name_hash, char const * value, std::size_t value_length,
+                           Storage storage)
+{
+    // Keep load factor at or below 1/2
+    if(2 * (_size + 1) > _entry.size()) {
+        grow();
+    }
+
+    // Names missing from a frozen symbol table are keyed by name
+    auto symbol = _symbols ? _symbols->intern(name, length, name_hash) : ArgumentSymbolTable::no_symbol;
+
+    // Room for both copies first, so that growing the pool does not move
+    // one of them
+    if(storage != BORROW_NAME_AND_VALUE) {
+        reserve((symbol == ArgumentSymbolTable::no_symbol ? length : 0) + (storage == COPY_NAME_AND_VALUE ? value_length : 0));
+    }
+
+    Entry * entry;
+    if(symbol != ArgumentSymbolTable::no_symbol) {
+        entry = &_entry[probe(symbol)];
+        if(entry->value != nullptr) {
+            return false;
+        }
+        entry->name = nullptr;
+        entry->name_length = symbol;
+    } else {
+        entry = &_entry[probe(name, length, name_hash)];
+        if(entry->value != nullptr) {
+            return false;
+        }
+        entry->name = (storage == BORROW_NAME_AND_VALUE) ? name : copy(name, length);
+        entry->name_length = static_cast<std::uint32_t>(length);
+    }
+    entry->value = (storage == COPY_NAME_AND_VALUE) ? copy(value, value_length) : value;
+    entry->value_length = static_cast<std::uint32_t>(value_length);
+    ++_size;
+    return true;
+}
+
+ArgumentTable::Entry const * ArgumentTable::find(char const * name, std::size_t length) const
+{
+    if(_size == 0) {
+        return nullptr;
+    }
+
+    auto name_hash = hash(name, length);
+    std::uint32_t symbol;
+    std::size_t index;
+    if(_symbols && _symbols->find(name, length, name_hash, symbol)) {
+        index = probe(symbol);
+    } else if(_symbols && !_symbols->frozen()) {
+        return nullptr;
+    } else {
+        index = probe(name, length, name_hash);
+    }
+    return _entry[index].value != nullptr ? &_entry[index] : nullptr;
+}
+
+ArgumentTable::Entry const * ArgumentTable::find(std::string const & name) const
+{
+    return find(name.data(), name.length());
+}
+
+std::string ArgumentTable::name(Entry const & entry) const
+{
+    if(entry.name == nullptr) {
+        return _symbols->name(entry.name_length);
+    }
+    return std::string(entry.name, entry.name_length);
+}
+
+std::string ArgumentTable::value(Entry const & entry) const
+{
+    return std::string(entry.value, entry.value_length);
+}
+
+std::vector<ArgumentTable::Entry> const & ArgumentTable::entries() const
+{
+    return _entry;
+}
+
+std::size_t ArgumentTable::hash(char const * name, std::size_t length)
+{
+    std::size_t value = 14695981039346656037ULL;
+    for(std::size_t i = 0; i < length; ++i) {
+        value = (value ^ static_cast<unsigned char>(name[i])) * 1099511628211ULL;
+    }
+    return value;
+}
+
+std::size_t ArgumentTable::probe(char const * name, std::size_t length, std::size_t hash) const
+{
+    // Returns the slot holding name, or the empty slot where it belongs.
+    // Hashes are not stored, to keep entries small; lengths rule out most
+    // mismatches before any character is compared.
+    auto mask = _entry.size() - 1;
+    auto index = hash & mask;
+    while(_entry[index].value != nullptr) {
+        auto const & entry = _entry[index];
+        if(entry.name != nullptr && entry.name_length == length && compare_name(entry.name, entry.name_length, name, length) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+std::size_t ArgumentTable::probe(std::uint32_t symbol) const
+{
+    // Same as above, comparing symbols only
+    auto mask = _entry.size() - 1;
+    auto index = symbol_hash(symbol) & mask;
+    while(_entry[index].value != nullptr && (_entry[index].name != nullptr || _entry[index].name_length != symbol)) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+char const * ArgumentTable::copy(char const * data, std::size_t length)
+{
+    // Empty strings (switches) need no room
+    if(length == 0) {
+        return "";
+    }
+
+    // Room was made by reserve(), so the pool does not reallocate here
+    auto offset = _pool.size();
+    _pool.insert(_pool.end(), data, data + length);
+    return _pool.data() + offset;
+}
+
+void ArgumentTable::reserve(std::size_t length)
+{
+    if(_pool.capacity() - _pool.size() >= length) {
+        return;
+    }
+
+    // The pool starts small and doubles; copies keep their offsets
+    std::vector<char> pool;
+    pool.reserve(std::max(std::max<std::size_t>(2 * _pool.capacity(), 32), _pool.size() + length));
+    pool.insert(pool.end(), _pool.begin(), _pool.end());
+    pool.swap(_pool);
+    repoint(pool.data());
+}
+
+void ArgumentTable::repoint(char const * previous)
+{
+    // Moves entries pointing into [previous, previous + size) to the same
+    // offset in the pool. std::less orders pointers into unrelated arrays too.
+    std::less<char const *> less;
+    auto owned = [&](char const * data) {
+        return data != nullptr && !less(data, previous) && less(data, previous + _pool.size());
+    };
+    for(auto & entry : _entry) {
+        if(entry.value != nullptr && owned(entry.name)) {
+            entry.name = _pool.data() + (entry.name - previous);
+        }
+        if(entry.value != nullptr && owned(entry.value)) {
+            entry.value = _pool.data() + (entry.value - previous);
+        }
+    }
+}
+
+void ArgumentTable::grow()
+{
+    std::vector<Entry> previous(_entry.empty() ? 8 : 2 * _entry.size());
+    previous.swap(_entry);
+
+    // Names are unique, so entries go to the first free slot
+    auto mask = _entry.size() - 1;
+    for(auto const & entry : previous) {
+        if(entry.value != nullptr) {
+            auto hash = entry.name == nullptr ? symbol_hash(entry.name_length) : ArgumentTable::hash(entry.name, entry.name_length);
+            auto index = hash & mask;
+            while(_entry[index].value != nullptr) {
+                index = (index + 1) & mask;
+            }
+            _entry[index] = entry;
+        }
+    }
+}
+
 ArgumentParser::ArgumentParser(bool throw_on_parse_error, bool throw_on_conversion_error)
 : _verb(""),
   _error_message(""),
   _conversion_error(false),
   _throw_on_parse_error(throw_on_parse_error),
-  _throw_on_conversion_error(throw_on_conversion_error)
+  _throw_on_conversion_error(throw_on_conversion_error),
+  _remaining{0, nullptr},
+  _positional_policy(REJECT_POSITIONAL),
+  _validation_policy(ACCEPT_ANY_BYTES),
+  _selected_command(0)
 { }
 
+ArgumentParser::ArgumentParser(ArgumentParser const & other)
+: _verb(other._verb),
+  _error_message(other._error_message),
+  _conversion_error(other._conversion_error),
+  _throw_on_parse_error(other._throw_on_parse_error),
+  _throw_on_conversion_error(other._throw_on_conversion_error),
+  _argument(other._argument),
+  _remaining(other._remaining),
+  _positional_policy(other._positional_policy),
+  _validation_policy(other._validation_policy),
+  _positional(other._positional),
+  _selected_command(other._selected_command),
+  _schema(other._schema ? new Schema(*other._schema) : nullptr)
+{ }
+
+ArgumentParser & ArgumentParser::operator=(ArgumentParser const & other)
+{
+    if(this != &other) {
+        _verb = other._verb;
+        _error_message = other._error_message;
+        _conversion_error = other._conversion_error;
+        _throw_on_parse_error = other._throw_on_parse_error;
+        _throw_on_conversion_error = other._throw_on_conversion_error;
+        _argument = other._argument;
+        _remaining = other._remaining;
+        _positional_policy = other._positional_policy;
+        _validation_policy = other._validation_policy;
+        _positional = other._positional;
+        _selected_command = other._selected_command;
+        _schema.reset(other._schema ? new Schema(*other._schema) : nullptr);
+    }
+    return *this;
+}
+
 ArgumentParser::~ArgumentParser()
 { }
 
-bool ArgumentParser::error()
+ArgumentParser::Schema::Schema()
+: option_sorted(true),
+  command_schema_applied(false),
+  base_option_count(0),
+  base_default_count(0),
+  option_slot_rebuilt(false),
+  base_embedded_default_saved(false)
+{ }
+
+bool ArgumentParser::error()
+{
+    return _conversion_error;
+}
+
+std::string ArgumentParser::get_error_message()
+{
+    return _error_message;
+}
+
+std::vector<std::string> ArgumentParser::get_suggestions() const
+{
+    return _schema ? _schema->suggestion : std::vector<std::string>();
+}
+
+bool ArgumentParser::parse(int argc, char* argv[], ArgumentFormat format)
+{
+    _verb.clear();
+    _argument.clear();
+    _error_message.clear();
+    if(_schema) {
+        _schema->suggestion.clear();
+    }
+    _conversion_error = false;
+    _remaining.argc = 0;
+    _remaining.argv = argv + argc;
+    _positional.clear();
+    _selected_command = 0;
+    restore_schema();
+
+    if(_validation_policy != ACCEPT_ANY_BYTES && !validate_arguments(argc, argv)) {
+        return false;
+    }
+
+    int current = 1; // Skip argv[0], which is the program name
+
+    // The verb is optional, so "--" may come first when it ends options
+    bool leading_terminator = _positional_policy != REJECT_POSITIONAL && argc > 1 && std::strcmp(argv[current], "--") == 0;
+
+    if(format == ArgumentFormat::VERB_PARAM_SWITCH && argc > 1 && !leading_terminator && is_switch(argv[current])) {
+        std::stringstream msg;
+        msg << "Argument '" << argv[current] << "' is not valid; was expecting a verb, but it looks like a switch.";
+        handle_parse_error(msg.str());
+        return false;
+    }
+
+    // Collect command path or verb if necessary
+    if(_schema && !_schema->command.empty() && format != ArgumentFormat::PARAM_SWITCH) {
+        if(!select_command(argc, argv, current)) {
+            return false;
+        }
+    } else if(format == ArgumentFormat::VERB_PARAM_SWITCH && argc > 1 && !leading_terminator) {
+        _verb = argv[current];
+        ++current;
+    }
+
+    if(format == ArgumentFormat::GNU_PARAM_SWITCH) {
+        if(_schema && _schema->option_slot.empty() && !_schema->option.empty()) {
+            index_options();
+        }
+        if(!parse_gnu(current, argc, argv)) {
+            return false;
+        }
+        apply_defaults();
+        return true;
+    }
+
+    // Process switches and PV pairs
+    while(current < argc) {
+
+        if(_positional_policy != REJECT_POSITIONAL && std::strcmp(argv[current], "--") == 0) {
+            end_options(current + 1, argc, argv);
+            break;
+        }
+
+        if(is_switch(argv[current])) {
+            auto raw_name = argv[current];
+            auto name = get_stripped_switch_name(argv[current]);
+
+            // Switch must have at least one char
+            if(name.empty()) {
+                std::stringstream msg;
+                msg << "Argument '" << raw_name << "' is not a valid switch.";
+                handle_parse_error(msg.str());
+                return false;
+            }
+
+            std::string value = "";
+            ++current;
+
+            if(current < argc && !is_switch(argv[current])) {
+                value = argv[current];
+                ++current;
+            }
+
+            // No repeated switches allowed
+            if(!_argument.insert(name.data(), name.length(), value.data(), value.length())) {
+                std::stringstream msg;
+                msg << "Argument '" << raw_name << "' is present multiple times.";
+                handle_parse_error(msg.str());
+                return false;
+            }
+
+        } else if(_positional_policy == COLLECT_POSITIONAL) {
+            _positional.push_back(argv[current]);
+            ++current;
+
+        } else if(_positional_policy == STOP_AT_POSITIONAL) {
+            end_options(current, argc, argv);
+            break;
+
+        } else {
+            // No consecutive values allowed
+            std::stringstream msg;
+            msg << "Argument '" << argv[current] << "' is not valid; was expecting a switch, but it looks like a value.";
+            handle_parse_error(msg.str());
+            return false;
+        }
+    }
+    apply_defaults();
+    return true;
+}
+
+void ArgumentParser::declare_switch(std::string const & name)
+{
+    declare(name, OPTION_SWITCH);
+}
+
+void ArgumentParser::declare_param(std::string const & name)
+{
+    declare(name, OPTION_PARAM);
+}
+
+void ArgumentParser::set_symbol_table(std::shared_ptr<ArgumentSymbolTable> symbols)
+{
+    _verb = "";
+    _positional.clear();
+    _remaining.argc = 0;
+    _argument.set_symbol_table(symbols);
+}
+
+void ArgumentParser::set_default(std::string const & name, std::string const & value)
+{
+    ensure_schema();
+    auto & schema = *_schema;
+
+    // Command schemas only append; apply_defaults() lets the last one win
+    if(!schema.command_schema_applied) {
+        for(auto & entry : schema.default_argument) {
+            if(entry.first == name) {
+                entry.second = value;
+                return;
+            }
+        }
+    }
+    schema.default_argument.emplace_back(name, value);
+}
+
+void ArgumentParser::add_command(std::string const & path, CommandHandler handler, CommandSchema schema)
+{
+    // Duplicates and intermediate paths are sorted out by index_commands()
+    ensure_schema();
+    _schema->command.push_back(Command{path, handler, schema});
+    _schema->command_slot.clear();
+}
+
+int ArgumentParser::dispatch(int default_value)
+{
+    _error_message = "";
+    _conversion_error = false;
+
+    if(_selected_command == 0 || !_schema->command[_selected_command - 1].handler) {
+        handle_conversion_error("Command is missing or incomplete, and it has no handler.");
+        return default_value;
+    }
+    return _schema->command[_selected_command - 1].handler(*this);
+}
+
+void ArgumentParser::set_positional_policy(PositionalPolicy policy)
+{
+    _positional_policy = policy;
+}
+
+void ArgumentParser::set_validation_policy(ValidationPolicy policy)
+{
+    _validation_policy = policy;
+}
+
+bool ArgumentParser::validate_arguments(int argc, char* argv[])
+{
+    auto reject_control = (_validation_policy == REQUIRE_UTF8_NO_CONTROL);
+    for(int i = 1; i < argc; ++i) {
+        auto length = std::strlen(argv[i]);
+        auto valid = valid_utf8_prefix(argv[i], length, reject_control);
+        if(valid != length) {
+            // The argument itself is not echoed, as it is not safe to print
+            std::stringstream msg;
+            if(reject_control && valid_utf8_prefix(argv[i], length, false) == length) {
+                msg << "Argument " << i << " contains a control character at byte " << valid << ".";
+            } else {
+                msg << "Argument " << i << " is not valid UTF-8 at byte " << valid << ".";
+            }
+            handle_parse_error(msg.str());
+            return false;
+        }
+    }
+    return true;
+}
+
+ArgumentSpan ArgumentParser::get_remaining_arguments() const
+{
+    return _remaining;
+}
+
+std::vector<char *> const & ArgumentParser::get_positional_arguments() const
+{
+    return _positional;
+}
+
+void ArgumentParser::end_options(int first, int argc, char* argv[])
+{
+    _remaining.argc = argc - first;
+    _remaining.argv = argv + first;
+    if(_positional_policy == COLLECT_POSITIONAL) {
+        _positional.insert(_positional.end(), argv + first, argv + argc);
+    }
+}
+
+void ArgumentParser::ensure_schema()
+{
+    if(!_schema) {
+        _schema.reset(new Schema());
+    }
+}
+
+void ArgumentParser::declare(std::string const & name, OptionKind kind)
+{
+    ensure_schema();
+    auto & schema = *_schema;
+    auto hash = ArgumentTable::hash(name.data(), name.length());
+    if(schema.command_schema_applied) {
+        // Command schemas find the base options sorted and indexed; theirs
+        // are appended and the index points to them until restore_schema()
+        schema.option.push_back(OptionSpec{name, kind, hash});
+        if(2 * schema.option.size() > schema.option_slot.size()) {
+            index_options();
+            schema.option_slot_rebuilt = true;
+        } else {
+            auto slot = find_option_slot(name.data(), name.length(), hash);
+            schema.option_slot_undo.emplace_back(slot, schema.option_slot[slot]);
+            schema.option_slot[slot] = schema.option.size();
+        }
+    } else {
+        // Appended as is; sort_options() orders them and drops
+        // redeclarations once, on first use. Names declared in order keep
+        // the vector sorted.
+        schema.option_sorted = schema.option_sorted && (schema.option.empty() || schema.option.back().name < name);
+        schema.option.push_back(OptionSpec{name, kind, hash});
+
+        // Index is rebuilt on next parse()
+        schema.option_slot.clear();
+    }
+
+    if(name.length() == 1) {
+        schema.short_option.resize(256, OPTION_UNDECLARED);
+        auto & short_kind = schema.short_option[static_cast<unsigned char>(name[0])];
+        if(schema.command_schema_applied) {
+            schema.short_option_undo.emplace_back(name[0], short_kind);
+        }
+        short_kind = kind;
+    }
+}
+
+void ArgumentParser::sort_options() const
+{
+    // Const, as the order is not observable; the schema is not
+    auto & schema = *_schema;
+    if(schema.option_sorted) {
+        return;
+    }
+
+    // Stable, so the last declaration of a name ends its run and wins
+    std::stable_sort(schema.option.begin(), schema.option.end(),
+        [](OptionSpec const & a, OptionSpec const & b) {
+            return a.name < b.name;
+        });
+    std::size_t size = 0;
+    for(auto & option : schema.option) {
+        if(size != 0 && schema.option[size - 1].name == option.name) {
+            schema.option[size - 1].kind = option.kind;
+        } else {
+            if(&schema.option[size] != &option) {
+                schema.option[size] = std::move(option);
+            }
+            ++size;
+        }
+    }
+    schema.option.resize(size);
+    schema.option_sorted = true;
+}
+
+void ArgumentParser::index_options()
+{
+    auto & schema = *_schema;
+    sort_options();
+
+    // Open addressing, load factor at or below 1/2
+    std::size_t size = 16;
+    while(size < 2 * schema.option.size()) {
+        size *= 2;
+    }
+    schema.option_slot.assign(size, 0);
+
+    // Names declared again by a command schema take over the slot
+    for(std::size_t position = 0; position < schema.option.size(); ++position) {
+        auto const & option = schema.option[position];
+        schema.option_slot[find_option_slot(option.name.data(), option.name.length(), option.hash)] = position + 1;
+    }
+}
+
+std::size_t ArgumentParser::find_option_slot(char const * name, std::size_t length, std::size_t hash) const
+{
+    // Returns the slot holding name, or the empty slot where it belongs
+    auto const & schema = *_schema;
+    auto mask = schema.option_slot.size() - 1;
+    auto index = hash & mask;
+    while(schema.option_slot[index] != 0) {
+        auto const & option = schema.option[schema.option_slot[index] - 1];
+        if(option.hash == hash && compare_name(option.name.data(), option.name.length(), name, length) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+ArgumentParser::OptionSpec const * ArgumentParser::find_option(char const * name, std::size_t length, std::size_t hash) const
+{
+    if(!_schema || _schema->option_slot.empty()) {
+        return nullptr;
+    }
+
+    auto slot = _schema->option_slot[find_option_slot(name, length, hash)];
+    return slot != 0 ? &_schema->option[slot - 1] : nullptr;
+}
+
+bool ArgumentParser::shadowed(OptionSpec const & option) const
+{
+    // Only command schemas leave earlier declarations of a name in place
+    return _schema->command_schema_applied && find_option(option.name.data(), option.name.length(), option.hash) != &option;
+}
+
+void ArgumentParser::index_commands()
+{
+    auto & schema = *_schema;
+
+    // Add intermediate paths ("db" for "db compact") as commands without
+    // handler, then merge repeated paths keeping the latest registration
+    auto count = schema.command.size();
+    for(std::size_t i = 0; i < count; ++i) {
+        auto const path = schema.command[i].path;
+        for(auto space = path.find(' '); space != std::string::npos; space = path.find(' ', space + 1)) {
+            schema.command.push_back(Command{path.substr(0, space), nullptr, nullptr});
+        }
+    }
+    std::stable_sort(schema.command.begin(), schema.command.end(),
+        [](Command const & a, Command const & b) {
+            return a.path < b.path;
+        });
+
+    std::vector<Command> merged;
+    for(auto & command : schema.command) {
+        if(merged.empty() || merged.back().path != command.path) {
+            merged.push_back(command);
+        } else {
+            if(command.handler) {
+                merged.back().handler = command.handler;
+            }
+            if(command.schema) {
+                merged.back().schema = command.schema;
+            }
+        }
+    }
+    schema.command.swap(merged);
+
+    // Hash and displace: paths are grouped in buckets of about four, then,
+    // largest bucket first, each bucket gets the first seed that sends all
+    // its paths to free slots. Lookups take one hash and one comparison.
+    std::size_t buckets = 1;
+    while(4 * buckets < schema.command.size()) {
+        buckets *= 2;
+    }
+    std::size_t size = 1;
+    while(size < 2 * schema.command.size()) {
+        size *= 2;
+    }
+
+    std::vector<std::size_t> hash(schema.command.size());
+    std::vector<std::vector<std::size_t>> bucket(buckets);
+    for(std::size_t i = 0; i < schema.command.size(); ++i) {
+        hash[i] = ArgumentTable::hash(schema.command[i].path.data(), schema.command[i].path.length());
+        bucket[hash[i] & (buckets - 1)].push_back(i);
+    }
+    std::stable_sort(bucket.begin(), bucket.end(),
+        [](std::vector<std::size_t> const & a, std::vector<std::size_t> const & b) {
+            return a.size() > b.size();
+        });
+
+    // Seeds are tried up to a limit; should a bucket not fit, start over
+    // with a larger table
+    std::size_t const seed_limit = 4096;
+    std::vector<std::size_t> slot;
+    bool placed = false;
+
+    while(!placed) {
+        schema.command_displacement.assign(buckets, 0);
+        schema.command_slot.assign(size, 0);
+        placed = true;
+
+        for(auto const & members : bucket) {
+            if(members.empty()) {
+                break;
+            }
+            std::size_t seed = 1;
+            for(; seed <= seed_limit; ++seed) {
+                slot.clear();
+                for(auto i : members) {
+                    auto candidate = displace(hash[i], seed) & (size - 1);
+                    if(schema.command_slot[candidate] != 0 || std::find(slot.begin(), slot.end(), candidate) != slot.end()) {
+                        break;
+                    }
+                    slot.push_back(candidate);
+                }
+                if(slot.size() == members.size()) {
+                    break;
+                }
+            }
+            if(seed > seed_limit) {
+                placed = false;
+                size *= 2;
+                break;
+            }
+            for(std::size_t j = 0; j < members.size(); ++j) {
+                schema.command_slot[slot[j]] = members[j] + 1;
+            }
+            schema.command_displacement[hash[members[0]] & (buckets - 1)] = seed;
+        }
+    }
+}
+
+std::size_t ArgumentParser::find_command(char const * path, std::size_t length) const
+{
+    auto const & schema = *_schema;
+    auto hash = ArgumentTable::hash(path, length);
+    auto seed = schema.command_displacement[hash & (schema.command_displacement.size() - 1)];
+    auto position = schema.command_slot[displace(hash, seed) & (schema.command_slot.size() - 1)];
+
+    if(position != 0 && compare_name(schema.command[position - 1].path.data(), schema.command[position - 1].path.length(), path, length) == 0) {
+        return position;
+    }
+    return 0;
+}
+
+bool ArgumentParser::select_command(int argc, char* argv[], int & current)
+{
+    if(_schema->command_slot.empty()) {
+        index_commands();
+    }
+
+    // Longest sequence of leading arguments forming a registered path
+    std::vector<std::size_t> chain;
+    std::string path;
+    while(current < argc && !is_option_token(argv[current])) {
+        auto length = path.length();
+        if(!path.empty()) {
+            path += ' ';
+        }
+        path += argv[current];
+
+        auto position = find_command(path.data(), path.length());
+        if(position == 0) {
+            path.resize(length);
+            break;
+        }
+        chain.push_back(position);
+        ++current;
+    }
+
+    // A following word is only allowed after a command that has a handler
+    if(current < argc && !is_option_token(argv[current]) &&
+       (chain.empty() || !_schema->command[chain.back() - 1].handler)) {
+        std::stringstream msg;
+        msg << "Argument '" << argv[current] << "' is not a recognized command" << (path.empty() ? "." : " of '") << path << (path.empty() ? "" : "'.");
+        handle_parse_error(msg.str());
+        return false;
+    }
+    if(chain.empty()) {
+        return true;
+    }
+
+    _verb = path;
+    _selected_command = chain.back();
+
+    // Build the schema of the selected path only
+    for(auto position : chain) {
+        auto const & command_schema = _schema->command[position - 1].schema;
+        if(command_schema) {
+            auto & schema = *_schema;
+            if(!schema.command_schema_applied) {
+                sort_options();
+                if(schema.option_slot.empty()) {
+                    index_options();
+                }
+                schema.base_option_count = schema.option.size();
+                schema.base_default_count = schema.default_argument.size();
+                schema.command_schema_applied = true;
+            }
+            command_schema(*this);
+        }
+    }
+    return true;
+}
+
+void ArgumentParser::restore_schema()
+{
+    if(!_schema || !_schema->command_schema_applied) {
+        return;
+    }
+
+    auto & schema = *_schema;
+    if(schema.option_slot_rebuilt) {
+        schema.option_slot.clear();
+        schema.option_slot_rebuilt = false;
+    } else {
+        // Reverse order leaves the probe sequences as they were
+        for(auto it = schema.option_slot_undo.rbegin(); it != schema.option_slot_undo.rend(); ++it) {
+            schema.option_slot[it->first] = it->second;
+        }
+    }
+    schema.option_slot_undo.clear();
+    schema.option.erase(schema.option.begin() + schema.base_option_count, schema.option.end());
+
+    for(auto it = schema.short_option_undo.rbegin(); it != schema.short_option_undo.rend(); ++it) {
+        schema.short_option[it->first] = it->second;
+    }
+    schema.short_option_undo.clear();
+
+    schema.default_argument.erase(schema.default_argument.begin() + schema.base_default_count, schema.default_argument.end());
+    if(schema.base_embedded_default_saved) {
+        schema.embedded_default.swap(schema.base_embedded_default);
+        schema.base_embedded_default.clear();
+        schema.base_embedded_default_saved = false;
+    }
+    schema.command_schema_applied = false;
+}
+
+void ArgumentParser::set_defaults(ArgumentDefaults const & defaults)
 {
-    return _conversion_error;
+    // The text was validated on construction, so it only needs splitting:
+    // an option followed by a token not starting with '-' has a value
+    auto text = defaults._text;
+    auto length = defaults._length;
+
+    ensure_schema();
+    auto & schema = *_schema;
+    if(schema.command_schema_applied && !schema.base_embedded_default_saved) {
+        schema.base_embedded_default.swap(schema.embedded_default);
+        schema.base_embedded_default_saved = true;
+    }
+    schema.embedded_default.clear();
+    schema.embedded_default.reserve(defaults.size());
+    auto i = ArgumentDefaults::skip_spaces(text, length, 0);
+    while(i < length) {
+        auto name = i + 1;
+        auto name_end = ArgumentDefaults::token_end(text, length, name);
+        auto value = ArgumentDefaults::skip_spaces(text, length, name_end);
+        auto value_end = value;
+        if(value < length && text[value] != '-') {
+            value_end = ArgumentDefaults::token_end(text, length, value);
+        }
+        schema.embedded_default.push_back(EmbeddedDefault{text + name, name_end - name,
+                                                          ArgumentTable::hash(text + name, name_end - name),
+                                                          text + value, value_end - value});
+        i = ArgumentDefaults::skip_spaces(text, length, value_end);
+    }
 }
 
-std::string ArgumentParser::get_error_message()
+void ArgumentParser::apply_defaults()
 {
-    return _error_message;
+    if(!_schema) {
+        return;
+    }
+    auto const & schema = *_schema;
+
+    // insert() leaves names given in the command line alone
+    for(auto const & entry : schema.embedded_default) {
+        _argument.insert(entry.name, entry.name_length, entry.hash, entry.value, entry.value_length,
+                         ArgumentTable::BORROW_NAME_AND_VALUE);
+    }
+
+    // Backwards, so a default set again by a command schema wins
+    for(auto it = schema.default_argument.rbegin(); it != schema.default_argument.rend(); ++it) {
+        if(_argument.find(it->first) == nullptr) {
+            _argument.insert(it->first.data(), it->first.length(), it->second.data(), it->second.length());
+        }
+    }
 }
 
-bool ArgumentParser::parse(int argc, char* argv[], ArgumentFormat format)
+std::vector<ArgumentParser::OptionSpec const *> ArgumentParser::find_option_prefix(char const * prefix, std::size_t length) const
 {
-    _verb = "";
-    _argument.clear();
-    _error_message = "";
-    _conversion_error = false;
+    auto const & schema = *_schema;
 
-    int current = 1; // Skip argv[0], which is the program name
+    // Base names are sorted, so those starting with prefix are contiguous.
+    // Comparing only their first 'length' characters keeps the order.
+    auto base_end = schema.option.begin() + (schema.command_schema_applied ? schema.base_option_count : schema.option.size());
+    auto first = std::lower_bound(schema.option.begin(), base_end, prefix,
+        [length](OptionSpec const & option, char const * key) {
+            return compare_name(option.name.data(), std::min(option.name.length(), length), key, length) < 0;
+        });
+    auto last = std::upper_bound(first, base_end, prefix,
+        [length](char const * key, OptionSpec const & option) {
+            return compare_name(option.name.data(), std::min(option.name.length(), length), key, length) > 0;
+        });
 
-    // Collect verb if necessary
-    if(format == ArgumentFormat::VERB_PARAM_SWITCH ) {
-        if(argc > 1) {
-            if(!is_switch(argv[current])) {
-                _verb = argv[current];
-                ++current;
-            } else {
-                if(_throw_on_parse_error) {
-                    std::stringstream msg;
-                    msg << "Argument '" << argv[current] << "' is not valid; was expecting a verb, but it looks like a switch.";
-                    throw std::invalid_argument(msg.str());
-                }
-                return false;
-            }
+    std::vector<OptionSpec const *> options;
+    for(auto it = first; it != last; ++it) {
+        if(!shadowed(*it)) {
+            options.push_back(&*it);
         }
     }
 
-    // Process switches and PV pairs
+    // Those appended by command schemas are few, and unsorted
+    auto count = options.size();
+    for(auto it = base_end; it != schema.option.end(); ++it) {
+        if(it->name.length() >= length && compare_name(it->name.data(), length, prefix, length) == 0 && !shadowed(*it)) {
+            options.push_back(&*it);
+        }
+    }
+    if(options.size() != count) {
+        std::sort(options.begin(), options.end(),
+            [](OptionSpec const * a, OptionSpec const * b) {
+                return a->name < b->name;
+            });
+    }
+    return options;
+}
+
+std::vector<std::string> ArgumentParser::complete(std::string const & prefix, std::size_t limit) const
+{
+    std::vector<std::string> names;
+    if(!_schema) {
+        return names;
+    }
+    sort_options();
+    auto options = find_option_prefix(prefix.data(), prefix.length());
+    for(std::size_t i = 0; i < options.size() && (limit == 0 || names.size() < limit); ++i) {
+        names.push_back(options[i]->name);
+    }
+    return names;
+}
+
+bool ArgumentParser::parse_gnu(int current, int argc, char* argv[])
+{
+    // Tokens are scanned in place; strings are only built when storing
     while(current < argc) {
+        char const * token = argv[current++];
 
-        if(is_switch(argv[current])) {
-            auto raw_name = argv[current];
-            auto name = get_stripped_switch_name(argv[current]);
+        // Lone "-" is an operand by convention
+        if(!is_option_token(token)) {
+            if(_positional_policy == COLLECT_POSITIONAL) {
+                _positional.push_back(argv[current - 1]);
+                continue;
+            }
+            if(_positional_policy == STOP_AT_POSITIONAL) {
+                end_options(current - 1, argc, argv);
+                break;
+            }
 
-            // Switch must have at least one char
-            if(name.empty()) {
-                std::stringstream msg;
-                msg << "Argument '" << raw_name << "' is not a valid switch.";
-                handle_parse_error(msg.str());
+            std::stringstream msg;
+            msg << "Argument '" << token << "' is not valid; was expecting a switch, but it looks like a value.";
+            handle_parse_error(msg.str());
+            return false;
+        }
+
+        if(token[1] != '-') {
+            if(!parse_gnu_short_options(token, current, argc, argv)) {
+                return false;
+            }
+        } else if(token[2] != '\0') {
+            if(!parse_gnu_long_option(token, current, argc, argv)) {
                 return false;
             }
+        } else {
+            // "--" ends option processing
+            end_options(current, argc, argv);
+            break;
+        }
+    }
+    return true;
+}
 
-            std::string value = "";
-            ++current;
+bool ArgumentParser::parse_gnu_long_option(char const * token, int & current, int argc, char* argv[])
+{
+    auto name = token + 2;
+    auto end = name;
+    while(*end != '\0' && *end != '=') {
+        ++end;
+    }
+    auto length = static_cast<std::size_t>(end - name);
 
-            if(current < argc && !is_switch(argv[current])) {
-                value = argv[current];
-                ++current;
-            }
+    if(length == 0) {
+        std::stringstream msg;
+        msg << "Argument '" << token << "' is not a valid switch.";
+        handle_parse_error(msg.str());
+        return false;
+    }
 
-            // No repeated switches allowed
-            if(_argument.find(name) != _argument.end()) {
-                std::stringstream msg;
-                msg << "Argument '" << raw_name << "' is present multiple times.";
-                handle_parse_error(msg.str());
-                return false;
+    auto hash = ArgumentTable::hash(name, length);
+    auto option = find_option(name, length, hash);
+    if(option == nullptr && _schema && !_schema->option.empty()) {
+        // Accept unique abbreviations, stored under the full option name
+        auto options = find_option_prefix(name, length);
+        if(options.empty()) {
+            suggest_options(name, length);
+
+            std::stringstream msg;
+            msg << "Argument '" << token << "' is not a recognized option.";
+            for(std::size_t i = 0; i < _schema->suggestion.size(); ++i) {
+                msg << (i == 0 ? " Did you mean '--" : (i + 1 == _schema->suggestion.size() ? "' or '--" : "', '--")) << _schema->suggestion[i];
+            }
+            msg << (_schema->suggestion.empty() ? "" : "'?");
+            handle_parse_error(msg.str());
+            return false;
+        }
+        if(options.size() > 1) {
+            std::stringstream msg;
+            msg << "Argument '" << token << "' is ambiguous; could be";
+            for(std::size_t i = 0; i < options.size(); ++i) {
+                msg << (i == 0 ? " '--" : ", '--") << options[i]->name << "'";
             }
-            _argument[name] = value;
+            msg << ".";
+            handle_parse_error(msg.str());
+            return false;
+        }
+        option = options.front();
+        name = option->name.data();
+        length = option->name.length();
+        hash = option->hash;
+    }
 
-        } else {
-            // No consecutive values allowed
+    // Names and values point into argv, except for expanded abbreviations
+    auto storage = (name == token + 2) ? ArgumentTable::BORROW_NAME_AND_VALUE : ArgumentTable::COPY_NAME;
+    char const * value = "";
+    if(*end == '=') {
+        if(option != nullptr && option->kind == OPTION_SWITCH) {
             std::stringstream msg;
-            msg << "Argument '" << argv[current] << "' is not valid; was expecting a switch, but it looks like a value.";
+            msg << "Argument '" << token << "' is a switch and does not take a value.";
+            handle_parse_error(msg.str());
+            return false;
+        }
+        value = end + 1;
+
+    } else if(option != nullptr && option->kind == OPTION_PARAM) {
+        if(current >= argc) {
+            std::stringstream msg;
+            msg << "Argument '" << token << "' requires a value.";
+            handle_parse_error(msg.str());
+            return false;
+        }
+        value = argv[current++];
+
+    } else if(option == nullptr && current < argc && !is_option_token(argv[current])) {
+        value = argv[current++];
+    }
+
+    return store_argument(token, name, length, hash, value, storage);
+}
+
+bool ArgumentParser::parse_gnu_short_options(char const * token, int & current, int argc, char* argv[])
+{
+    for(auto it = token + 1; *it != '\0'; ++it) {
+        auto kind = (!_schema || _schema->short_option.empty()) ?
+                        OPTION_UNDECLARED : static_cast<OptionKind>(_schema->short_option[static_cast<unsigned char>(*it)]);
+
+        if(kind == OPTION_UNDECLARED && _schema && !_schema->option.empty()) {
+            std::stringstream msg;
+            msg << "Option '-" << *it << "' in argument '" << token << "' is not a recognized option.";
             handle_parse_error(msg.str());
             return false;
         }
+
+        if(kind == OPTION_PARAM) {
+            // Value is either attached (-j8) or the next argument (-j 8)
+            char const * value = it + 1;
+            if(*value == '\0') {
+                if(current >= argc) {
+                    std::stringstream msg;
+                    msg << "Option '-" << *it << "' in argument '" << token << "' requires a value.";
+                    handle_parse_error(msg.str());
+                    return false;
+                }
+                value = argv[current++];
+            }
+            return store_argument(token, it, 1, ArgumentTable::hash(it, 1), value, ArgumentTable::BORROW_NAME_AND_VALUE);
+        }
+
+        if(!store_argument(token, it, 1, ArgumentTable::hash(it, 1), "", ArgumentTable::BORROW_NAME_AND_VALUE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArgumentParser::store_argument(char const * token, char const * name, std::size_t length, std::size_t hash, char const * value,
+                                    ArgumentTable::Storage storage)
+{
+    // No repeated switches allowed
+    if(!_argument.insert(name, length, hash, value, std::strlen(value), storage)) {
+        std::stringstream msg;
+        msg << "Argument '" << token << "' is present multiple times.";
+        handle_parse_error(msg.str());
+        return false;
     }
     return true;
 }
@@ -119,10 +1510,58 @@ std::string ArgumentParser::get_stripped_switch_name(std::string const & token)
     return token;
 }
 
+void ArgumentParser::suggest_options(char const * name, std::size_t length)
+{
+    std::size_t const max_suggestions = 3;
+    if(length == 0 || length > 64) {
+        return;
+    }
+
+    // Allow roughly one edit every three characters
+    auto limit = std::min<std::size_t>(3, (length + 2) / 3);
+
+    std::uint64_t match[256] = {};
+    for(std::size_t i = 0; i < length; ++i) {
+        match[static_cast<unsigned char>(name[i])] |= std::uint64_t(1) << i;
+    }
+
+    // Rank by distance, then prefer names with the same first letter
+    std::vector<std::pair<std::size_t, OptionSpec const *>> candidates;
+    for(auto const & option : _schema->option) {
+        auto option_length = option.name.length();
+        if(option_length < 2 || shadowed(option)) {
+            continue;
+        }
+        // Distance is at least the difference in length
+        if((option_length > length ? option_length - length : length - option_length) > limit) {
+            continue;
+        }
+
+        auto distance = edit_distance(match, length, option.name.data(), option_length, limit);
+        if(distance <= limit) {
+            auto rank = 2 * distance + (option.name[0] != name[0] ? 1 : 0);
+            candidates.emplace_back(rank, &option);
+        }
+    }
+
+    // Ties in alphabetical order
+    std::sort(candidates.begin(), candidates.end(),
+        [](std::pair<std::size_t, OptionSpec const *> const & a, std::pair<std::size_t, OptionSpec const *> const & b) {
+            return a.first != b.first ? a.first < b.first : a.second->name < b.second->name;
+        });
+    for(std::size_t i = 0; i < candidates.size() && i < max_suggestions; ++i) {
+        _schema->suggestion.push_back(candidates[i].second->name);
+    }
+}
+
 void ArgumentParser::handle_parse_error(std::string const & msg)
 {
     _verb = "";
     _argument.clear();
+    _positional.clear();
+    _remaining.argc = 0;
+    _selected_command = 0;
+    _error_message = msg;
     if(_throw_on_parse_error) {
         throw std::invalid_argument(msg);
     }
@@ -140,8 +1579,7 @@ void ArgumentParser::handle_conversion_error(std::string const & msg)
 
 bool ArgumentParser::is_present(std::string const & name) const
 {
-    auto it = _argument.find(name);
-    return (it != _argument.end()) || (name.compare(_verb) == 0);
+    return (_argument.find(name) != nullptr) || (name.compare(_verb) == 0);
 }
 
 std::string ArgumentParser::get_verb(std::string const & default_value)
@@ -163,24 +1601,24 @@ std::string ArgumentParser::get_as_string(std::string const & name)
     _error_message = "";
     _conversion_error = false;
 
-    auto it = _argument.find(name);
-    if(it == _argument.end()) {
+    auto entry = _argument.find(name);
+    if(entry == nullptr) {
         std::stringstream msg;
         msg << "Argument '" << name << "' is required but is not present.";
         handle_conversion_error(msg.str());
         return "";
     }
-    return it->second;
+    return _argument.value(*entry);
 }
 std::string ArgumentParser::get_as_string(std::string const & name, std::string const & default_value)
 {
     _error_message = "";
     _conversion_error = false;
-    auto it = _argument.find(name);
-    if(it == _argument.end()) {
+    auto entry = _argument.find(name);
+    if(entry == nullptr) {
         return default_value;
     }
-    return it->second;
+    return _argument.value(*entry);
 }
 
 bool ArgumentParser::case_independent_compare(std::string const & s1, std::string const & s2)
@@ -350,3 +1788,333 @@ double ArgumentParser::get_as_double(std::string const & name, double default_va
     }
     return double_value;
 }
+
+std::vector<char> ArgumentParser::snapshot() const
+{
+    // Sort names so readers can binary search the index
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.reserve(_argument.size());
+    for(auto const & entry : _argument.entries()) {
+        if(entry.value != nullptr) {
+            entries.emplace_back(_argument.name(entry), _argument.value(entry));
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    auto pool_size = _verb.size() + 1;
+    for(auto const & entry : entries) {
+        pool_size += entry.first.size() + entry.second.size() + 2;
+    }
+
+    std::vector<char> blob(snapshot_header_size + entries.size() * snapshot_entry_size);
+    blob.reserve(blob.size() + pool_size);
+
+    std::memcpy(&blob[0], snapshot_magic, sizeof(snapshot_magic));
+    write_u32(blob, 8, static_cast<std::uint32_t>(entries.size()));
+    write_u32(blob, 12, append_string(blob, _verb));
+    write_u32(blob, 16, static_cast<std::uint32_t>(_verb.size()));
+
+    auto index = snapshot_header_size;
+    for(auto const & entry : entries) {
+        write_u32(blob, index,      append_string(blob, entry.first));
+        write_u32(blob, index + 4,  static_cast<std::uint32_t>(entry.first.size()));
+        write_u32(blob, index + 8,  append_string(blob, entry.second));
+        write_u32(blob, index + 12, static_cast<std::uint32_t>(entry.second.size()));
+        index += snapshot_entry_size;
+    }
+    write_u32(blob, 4, static_cast<std::uint32_t>(blob.size()));
+
+    return blob;
+}
+
+bool ArgumentParser::load_snapshot(void const * data, std::size_t size)
+{
+    // Nothing from the previous parse survives, as in parse()
+    _verb = "";
+    _argument.clear();
+    _error_message = "";
+    if(_schema) {
+        _schema->suggestion.clear();
+    }
+    _conversion_error = false;
+    _remaining.argc = 0;
+    _remaining.argv = nullptr;
+    _positional.clear();
+    _selected_command = 0;
+    restore_schema();
+
+    ArgumentSnapshot view(data, size);
+    if(!view.valid()) {
+        handle_parse_error("Argument snapshot is not valid.");
+        return false;
+    }
+
+    auto base = static_cast<char const *>(data);
+    for(std::size_t index = 0; index < view.size(); ++index) {
+        std::uint32_t entry[4];
+        std::memcpy(entry, base + snapshot_header_size + index * snapshot_entry_size, sizeof(entry));
+        _argument.insert(base + entry[0], entry[1], base + entry[2], entry[3]);
+    }
+    _verb = view.get_verb();
+    return true;
+}
+
+ArgumentSnapshot::ArgumentSnapshot(void const * data, std::size_t size)
+: _data(static_cast<char const *>(data)),
+  _size(size),
+  _count(0),
+  _valid(false)
+{
+    if(_data == nullptr || _size < snapshot_header_size ||
+       std::memcmp(_data, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+       read_u32(4) > _size) {
+        return;
+    }
+
+    auto count = read_u32(8);
+    if(count > (_size - snapshot_header_size) / snapshot_entry_size) {
+        return;
+    }
+    if(!check_string(read_u32(12), read_u32(16))) {
+        return;
+    }
+
+    auto index = snapshot_header_size;
+    for(std::uint32_t i = 0; i < count; ++i) {
+        if(!check_string(read_u32(index), read_u32(index + 4)) ||
+           !check_string(read_u32(index + 8), read_u32(index + 12))) {
+            return;
+        }
+        index += snapshot_entry_size;
+    }
+
+    _count = count;
+    _valid = true;
+}
+
+bool ArgumentSnapshot::valid() const
+{
+    return _valid;
+}
+
+std::size_t ArgumentSnapshot::size() const
+{
+    return _count;
+}
+
+bool ArgumentSnapshot::is_present(char const * name) const
+{
+    return find(name) != nullptr || std::strcmp(name, get_verb()) == 0;
+}
+
+char const * ArgumentSnapshot::get_verb() const
+{
+    return _valid ? _data + read_u32(12) : "";
+}
+
+char const * ArgumentSnapshot::get(char const * name) const
+{
+    return find(name);
+}
+
+std::uint32_t ArgumentSnapshot::read_u32(std::size_t offset) const
+{
+    // Blob may be mapped at any address, so avoid unaligned loads
+    std::uint32_t value;
+    std::memcpy(&value, _data + offset, sizeof(value));
+    return value;
+}
+
+bool ArgumentSnapshot::check_string(std::uint32_t offset, std::uint32_t length) const
+{
+    return offset <= _size && length < _size - offset && _data[offset + length] == '\0';
+}
+
+char const * ArgumentSnapshot::find(char const * name) const
+{
+    auto length = std::strlen(name);
+    std::size_t low = 0;
+    std::size_t high = _count;
+
+    while(low < high) {
+        auto middle = low + (high - low) / 2;
+        auto entry = snapshot_header_size + middle * snapshot_entry_size;
+        auto key_length = read_u32(entry + 4);
+
+        auto result = std::memcmp(_data + read_u32(entry), name, std::min<std::size_t>(key_length, length));
+        if(result == 0) {
+            if(key_length == length) {
+                return _data + read_u32(entry + 8);
+            }
+            result = key_length < length ? -1 : 1;
+        }
+
+        if(result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return nullptr;
+}
+
+bool ArgumentParser::parse_scaled_value(std::string const & name, std::string const & value, ScaledUnit const * units,
+                                        bool ignore_case, unsigned long long maximum, unsigned long long & result)
+{
+    // Single pass: integral digits, optional fraction, then unit suffix
+    auto it = value.c_str();
+    unsigned long long integral = 0;
+    unsigned long long fraction = 0;
+    unsigned long long fraction_scale = 1;
+    bool overflow = false;
+    bool digits = false;
+
+    for(; *it >= '0' && *it <= '9'; ++it) {
+        unsigned digit = *it - '0';
+        overflow = overflow || integral > (std::numeric_limits<unsigned long long>::max() - digit) / 10;
+        integral = integral * 10 + digit;
+        digits = true;
+    }
+    if(*it == '.') {
+        for(++it; *it >= '0' && *it <= '9'; ++it) {
+            // Digits beyond 10^-18 cannot change the result
+            if(fraction_scale <= std::numeric_limits<unsigned long long>::max() / 10 / 10) {
+                fraction = fraction * 10 + (*it - '0');
+                fraction_scale *= 10;
+            }
+            digits = true;
+        }
+    }
+
+    auto unit = units;
+    for(; unit->suffix != nullptr; ++unit) {
+        auto suffix = unit->suffix;
+        auto rest = it;
+        while(*suffix != '\0' && *rest != '\0' &&
+              (ignore_case ? std::tolower(*suffix) == std::tolower(*rest) : *suffix == *rest)) {
+            ++suffix;
+            ++rest;
+        }
+        if(*suffix == '\0' && *rest == '\0') {
+            break;
+        }
+    }
+
+    if(!digits || unit->suffix == nullptr) {
+        std::stringstream msg;
+        msg << "Argument '" << name << "' value ('" << value << "') is not valid.";
+        handle_conversion_error(msg.str());
+        return false;
+    }
+
+    auto multiplier = unit->multiplier;
+    overflow = overflow || (integral != 0 && multiplier > maximum / integral);
+    if(!overflow) {
+        result = integral * multiplier;
+        if(fraction != 0) {
+            // fraction * multiplier / fraction_scale, exactly and without a wide
+            // intermediate: shift multiplier in bit by bit, keeping quotient and
+            // remainder (fraction < fraction_scale < 2^61, so nothing overflows)
+            unsigned long long fractional = 0;
+            unsigned long long remainder = 0;
+            for(int bit = std::numeric_limits<unsigned long long>::digits - 1; bit >= 0; --bit) {
+                fractional <<= 1;
+                remainder <<= 1;
+                if(remainder >= fraction_scale) {
+                    remainder -= fraction_scale;
+                    ++fractional;
+                }
+                if((multiplier >> bit) & 1) {
+                    remainder += fraction;
+                    if(remainder >= fraction_scale) {
+                        remainder -= fraction_scale;
+                        ++fractional;
+                    }
+                }
+            }
+            overflow = fractional > maximum - result;
+            result += fractional;
+        }
+    }
+
+    if(overflow) {
+        std::stringstream msg;
+        msg << "Argument '" << name << "' value ('" << value << "') is out of range.";
+        handle_conversion_error(msg.str());
+        return false;
+    }
+    return true;
+}
+
+unsigned long long ArgumentParser::get_as_bytes(std::string const & name, unsigned long long default_value)
+{
+    static ScaledUnit const units[] = {
+        { "",    1ULL },
+        { "B",   1ULL },
+        { "k",   1000ULL },
+        { "kB",  1000ULL },
+        { "M",   1000000ULL },
+        { "MB",  1000000ULL },
+        { "G",   1000000000ULL },
+        { "GB",  1000000000ULL },
+        { "T",   1000000000000ULL },
+        { "TB",  1000000000000ULL },
+        { "P",   1000000000000000ULL },
+        { "PB",  1000000000000000ULL },
+        { "E",   1000000000000000000ULL },
+        { "EB",  1000000000000000000ULL },
+        { "Ki",  1ULL << 10 },
+        { "KiB", 1ULL << 10 },
+        { "Mi",  1ULL << 20 },
+        { "MiB", 1ULL << 20 },
+        { "Gi",  1ULL << 30 },
+        { "GiB", 1ULL << 30 },
+        { "Ti",  1ULL << 40 },
+        { "TiB", 1ULL << 40 },
+        { "Pi",  1ULL << 50 },
+        { "PiB", 1ULL << 50 },
+        { "Ei",  1ULL << 60 },
+        { "EiB", 1ULL << 60 },
+        { nullptr, 0 }
+    };
+
+    auto value = get_as_string(name, std::string());
+    if(value.empty()) {
+        return default_value;
+    }
+
+    unsigned long long bytes;
+    if(!parse_scaled_value(name, value, units, true, std::numeric_limits<unsigned long long>::max(), bytes)) {
+        return default_value;
+    }
+    return bytes;
+}
+
+std::chrono::nanoseconds ArgumentParser::get_as_duration(std::string const & name, std::chrono::nanoseconds default_value)
+{
+    static ScaledUnit const units[] = {
+        { "",         1000000000ULL },
+        { "ns",       1ULL },
+        { "us",       1000ULL },
+        { "\xC2\xB5s", 1000ULL },
+        { "ms",       1000000ULL },
+        { "s",        1000000000ULL },
+        { "m",        60000000000ULL },
+        { "min",      60000000000ULL },
+        { "h",        3600000000000ULL },
+        { "d",        86400000000000ULL },
+        { nullptr, 0 }
+    };
+
+    auto value = get_as_string(name, std::string());
+    if(value.empty()) {
+        return default_value;
+    }
+
+    unsigned long long count;
+    auto maximum = static_cast<unsigned long long>(std::chrono::nanoseconds::max().count());
+    if(!parse_scaled_value(name, value, units, false, maximum, count)) {
+        return default_value;
+    }
+    return std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(count));
+}
@@ -7,7 +7,16 @@
 
 #pragma once
 #include <string>
-#include <unordered_map>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 
 /*
  * Describes the expected format of arguments to be parsed.
@@ -22,7 +31,429 @@ enum ArgumentFormat
 	/*
 	 *  executable [[-PARAM value] | [-SWITCH]]
 	 */
-	PARAM_SWITCH
+	PARAM_SWITCH,
+
+	/*
+	 *  executable [[--PARAM=value] | [--PARAM value] | [--SWITCH] |
+	 *              [-abc] | [-Pvalue] | [-P value]] [-- ...]
+	 *
+	 *  GNU/POSIX syntax, as accepted by getopt_long(). Single dash tokens
+	 *  are clusters of one-character options; double dash tokens are long
+	 *  options. A lone "--" ends option processing, and the arguments after
+	 *  it are available through get_remaining_arguments().
+	 *
+	 *  One-character options are switches unless declared with
+	 *  declare_param(). Undeclared long options take the next argument as
+	 *  value when it does not look like an option. Once any option has
+	 *  been declared, undeclared options are rejected, and long options
+	 *  can be abbreviated to any unique prefix (--verb for --verbose).
+	 *
+	 *  Names and values are not copied; see ArgumentParser::parse().
+	 */
+	GNU_PARAM_SWITCH
+};
+
+/*
+ * Describes what parse() does with positional arguments, i.e. arguments
+ * that are neither a switch nor the value of one.
+ */
+enum PositionalPolicy
+{
+	/*
+	 *  Positional arguments are parsing errors. Only GNU_PARAM_SWITCH
+	 *  recognizes the "--" terminator.
+	 */
+	REJECT_POSITIONAL,
+
+	/*
+	 *  Positional arguments are collected wherever they appear, and
+	 *  returned by get_positional_arguments(). A "--" argument ends option
+	 *  processing; all arguments after it are positional, and are also
+	 *  returned by get_remaining_arguments().
+	 */
+	COLLECT_POSITIONAL,
+
+	/*
+	 *  The first positional argument, or a "--" argument, ends option
+	 *  processing. The positional argument and all arguments after it
+	 *  (or the arguments after "--") are returned by
+	 *  get_remaining_arguments(), e.g. to exec a child command.
+	 */
+	STOP_AT_POSITIONAL
+};
+
+/*
+ * Describes the checks parse() runs on every argument (except argv[0])
+ * before parsing it. Failures are parsing errors.
+ */
+enum ValidationPolicy
+{
+	/*
+	 *  Arguments are taken as given.
+	 */
+	ACCEPT_ANY_BYTES,
+
+	/*
+	 *  Arguments must be well-formed UTF-8: no overlong encodings,
+	 *  surrogates or code points above U+10FFFF.
+	 */
+	REQUIRE_UTF8,
+
+	/*
+	 *  As REQUIRE_UTF8, and arguments must not contain control characters
+	 *  (U+0000 to U+001F, U+007F to U+009F), tabs and newlines included.
+	 */
+	REQUIRE_UTF8_NO_CONTROL
+};
+
+/*
+ * Range of arguments pointing into the argv array given to parse(). The
+ * range is always followed by the null pointer that terminates argv, so it
+ * can be handed to execv() and similar functions as is.
+ */
+struct ArgumentSpan
+{
+	int argc;
+	char ** argv;
+};
+
+class ArgumentParser;
+
+/*
+ * Declares the options and defaults of a command; see
+ * ArgumentParser::add_command().
+ */
+typedef std::function<void(ArgumentParser &)> CommandSchema;
+
+/*
+ * Runs a command; see ArgumentParser::add_command() and dispatch().
+ */
+typedef std::function<int(ArgumentParser &)> CommandHandler;
+
+/*
+ * Thread-safe table assigning small integer symbols to option names. A
+ * single table can be shared by many ArgumentParser instances (see
+ * ArgumentParser::set_symbol_table()), which then store symbols instead of
+ * their own copies of the names. Symbols are never removed.
+ *
+ * Every lookup takes the table's lock until freeze() is called, so parsers
+ * sharing a table in many threads contend on it; a frozen table is
+ * read-only and takes no lock.
+ */
+class ArgumentSymbolTable
+{
+public:
+    /*
+     * Returned by intern() for names missing from a frozen table.
+     */
+    static std::uint32_t const no_symbol = 0xFFFFFFFFU;
+
+    ArgumentSymbolTable();
+
+    /**
+     * @return Symbol for name, which is added if not present yet, or
+     *         no_symbol if it is not present and the table is frozen.
+     */
+    std::uint32_t intern(char const * name, std::size_t length);
+    std::uint32_t intern(char const * name, std::size_t length, std::size_t hash);
+    std::uint32_t intern(std::string const & name);
+
+    /**
+     * Interns all options declared in schema with declare_switch() and
+     * declare_param(), e.g. before freeze().
+     */
+    void intern_declared(ArgumentParser const & schema);
+
+    /**
+     * Makes the table read-only. Lookups no longer lock; names not in the
+     * table are not added, and parsers keep private copies of them instead.
+     */
+    void freeze();
+    bool frozen() const;
+
+    /**
+     * Looks name up without adding it. The hash, if given, must be
+     * ArgumentTable::hash(name, length).
+     *
+     * @return true if name is present, setting symbol.
+     */
+    bool find(char const * name, std::size_t length, std::uint32_t & symbol) const;
+    bool find(char const * name, std::size_t length, std::size_t hash, std::uint32_t & symbol) const;
+
+    /**
+     * @return Name of a symbol returned by intern().
+     */
+    std::string name(std::uint32_t symbol) const;
+
+    std::size_t size() const;
+
+private:
+    std::size_t probe(char const * name, std::size_t length, std::size_t hash) const;
+    bool find_unlocked(char const * name, std::size_t length, std::size_t hash, std::uint32_t & symbol) const;
+    void grow();
+
+private:
+    struct Name
+    {
+        std::uint32_t offset; // Into the pool
+        std::uint32_t length;
+        std::size_t hash;
+    };
+
+    mutable std::mutex _mutex;
+    std::atomic<bool> _frozen;        // Set once, under the lock
+    std::vector<std::uint32_t> _slot; // Symbol + 1, or 0; size is a power of two
+    std::vector<Name> _name;          // By symbol
+    std::vector<char> _pool;
+};
+
+/*
+ * Name/value storage used by ArgumentParser. Open addressing hash table
+ * whose entries point either to strings owned by the caller (borrowed) or
+ * to copies kept in a single pool; clearing keeps both the slots and the
+ * pool capacity, so parsing the same shape of command line repeatedly does
+ * not allocate. Slots and pool start small and grow with the content, so
+ * short command lines take little memory.
+ */
+class ArgumentTable
+{
+public:
+    struct Entry
+    {
+        char const * name;          // Null if keyed by symbol
+        char const * value;         // Null if the slot is free
+        std::uint32_t name_length;  // Symbol if keyed by symbol
+        std::uint32_t value_length;
+    };
+
+    /*
+     * What insert() copies; borrowed strings must stay alive and unchanged
+     * until the table is cleared.
+     */
+    enum Storage
+    {
+        COPY_NAME_AND_VALUE,
+        COPY_NAME,
+        BORROW_NAME_AND_VALUE
+    };
+
+    ArgumentTable();
+
+    /*
+     * Copies get their own pool holding the copied strings; borrowed
+     * strings stay borrowed.
+     */
+    ArgumentTable(ArgumentTable const & other);
+    ArgumentTable & operator=(ArgumentTable const & other);
+
+    /**
+     * Keys entries by symbols from the given table from now on, or by
+     * names if null; names missing from a frozen table are keyed by name
+     * too. Clears the table.
+     */
+    void set_symbol_table(std::shared_ptr<ArgumentSymbolTable> symbols);
+
+    void clear();
+    std::size_t size() const;
+
+    /**
+     * @return false if name is already present; the table is not modified.
+     */
+    bool insert(char const * name, std::size_t length, char const * value, std::size_t value_length,
+                Storage storage = COPY_NAME_AND_VALUE);
+    bool insert(char const * name, std::size_t length, std::size_t hash, char const * value, std::size_t value_length,
+                Storage storage = COPY_NAME_AND_VALUE);
+
+    /**
+     * @return Entry, or nullptr if name is not present.
+     */
+    Entry const * find(char const * name, std::size_t length) const;
+    Entry const * find(std::string const & name) const;
+
+    std::string name(Entry const & entry) const;
+    std::string value(Entry const & entry) const;
+
+    /**
+     * @return All slots; only those with a value hold an argument.
+     */
+    std::vector<Entry> const & entries() const;
+
+    /**
+     * Hash function used for names (FNV-1a).
+     */
+    static std::size_t hash(char const * name, std::size_t length);
+
+private:
+    std::size_t probe(char const * name, std::size_t length, std::size_t hash) const;
+    std::size_t probe(std::uint32_t symbol) const;
+    char const * copy(char const * data, std::size_t length);
+    void reserve(std::size_t length);
+    void repoint(char const * previous);
+    void grow();
+
+private:
+    std::vector<Entry> _entry; // Size is zero or a power of two
+    std::vector<char> _pool;   // Copies; entries are repointed when it grows
+    std::size_t _size;
+    std::shared_ptr<ArgumentSymbolTable> _symbols;
+};
+
+/*
+ * Default command line embedded in the binary, e.g. one per deployment
+ * profile:
+ *
+ *   constexpr ArgumentDefaults production("-cache 512MiB -timeout 250ms -verbose",
+ *                                         "cache= timeout= verbose");
+ *
+ * The text uses PARAM_SWITCH syntax: "-PARAM value" pairs and "-SWITCH"
+ * options, separated by spaces, tabs or newlines. The optional schema lists
+ * the accepted option names; those taking a value end with '='. Malformed
+ * text, repeated options, names not in the schema, parameters without value
+ * and switches with one make the constructor throw std::invalid_argument,
+ * which fails the build when the object is constexpr.
+ *
+ * C++11 constexpr functions can only recurse, a few levels per option, so
+ * texts with more than about 150 options exceed the usual constexpr depth
+ * limit (512); raise it with -fconstexpr-depth if needed. Scanning a token
+ * only adds depth logarithmic in its length, so long values are fine.
+ *
+ * Only a pointer to the text is kept, so it must outlive the object; string
+ * literals do. See ArgumentParser::set_defaults().
+ */
+class ArgumentDefaults
+{
+public:
+    constexpr ArgumentDefaults()
+      : _text(""), _length(0), _size(0)
+    {}
+
+    template <std::size_t N>
+    constexpr ArgumentDefaults(char const (&text)[N])
+      : _text(text), _length(N - 1), _size(count_options(text, N - 1, skip_spaces(text, N - 1, 0), "", 0))
+    {}
+
+    template <std::size_t N, std::size_t M>
+    constexpr ArgumentDefaults(char const (&text)[N], char const (&schema)[M])
+      : _text(text), _length(N - 1), _size(count_options(text, N - 1, skip_spaces(text, N - 1, 0), schema, M - 1))
+    {}
+
+    constexpr char const * text() const { return _text; }
+
+    /**
+     * @return Number of options in the text.
+     */
+    constexpr std::size_t size() const { return _size; }
+
+private:
+    friend class ArgumentParser;
+
+    static constexpr bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static constexpr std::size_t skip_spaces(char const * text, std::size_t length, std::size_t i)
+    {
+        return find_class(text, i, length, false);
+    }
+
+    static constexpr std::size_t token_end(char const * text, std::size_t length, std::size_t i)
+    {
+        return find_class(text, i, length, true);
+    }
+
+    // First index in [begin, end) whose character is (or is not) a space, or
+    // end. Halving the range keeps the recursion depth logarithmic in the
+    // token length; the left half is searched first, so the cost is still
+    // proportional to the distance scanned.
+    static constexpr std::size_t find_class(char const * text, std::size_t begin, std::size_t end, bool space)
+    {
+        return end - begin < 2 ? ((begin == end || is_space(text[begin]) == space) ? begin : end) :
+               find_right(text, find_class(text, begin, begin + (end - begin) / 2, space),
+                          begin + (end - begin) / 2, end, space);
+    }
+
+    static constexpr std::size_t find_right(char const * text, std::size_t found, std::size_t middle, std::size_t end,
+                                            bool space)
+    {
+        return found != middle ? found : find_class(text, middle, end, space);
+    }
+
+    static constexpr bool same(char const * a, char const * b, std::size_t length)
+    {
+        return length < 2 ? (length == 0 || *a == *b) :
+               same(a, b, length / 2) && same(a + length / 2, b + length / 2, length - length / 2);
+    }
+
+    // 0 if entry (from the schema) is not name, 1 for a switch, 2 for a
+    // parameter
+    static constexpr int entry_kind(char const * entry, std::size_t entry_length,
+                                    char const * name, std::size_t name_length)
+    {
+        return (entry_length == name_length + 1 && entry[name_length] == '=' && same(entry, name, name_length)) ? 2 :
+               (entry_length == name_length && same(entry, name, name_length)) ? 1 : 0;
+    }
+
+    static constexpr int schema_kind(char const * schema, std::size_t schema_length, std::size_t i,
+                                     char const * name, std::size_t name_length)
+    {
+        return i == schema_length ? 0 :
+               entry_kind(schema + i, token_end(schema, schema_length, i) - i, name, name_length) != 0 ?
+                   entry_kind(schema + i, token_end(schema, schema_length, i) - i, name, name_length) :
+                   schema_kind(schema, schema_length, skip_spaces(schema, schema_length, token_end(schema, schema_length, i)),
+                               name, name_length);
+    }
+
+    // Whether option (with its dash) is one of the tokens from i onwards
+    static constexpr bool contains_option(char const * text, std::size_t length, std::size_t i,
+                                          char const * option, std::size_t option_length)
+    {
+        return i != length &&
+               ((token_end(text, length, i) - i == option_length && same(text + i, option, option_length)) ||
+                contains_option(text, length, skip_spaces(text, length, token_end(text, length, i)), option, option_length));
+    }
+
+    // Number of options from the token at i onwards
+    static constexpr std::size_t count_options(char const * text, std::size_t length, std::size_t i,
+                                               char const * schema, std::size_t schema_length)
+    {
+        return i == length ? 0 : check_option(text, length, i, token_end(text, length, i), schema, schema_length);
+    }
+
+    static constexpr std::size_t check_option(char const * text, std::size_t length, std::size_t start, std::size_t end,
+                                              char const * schema, std::size_t schema_length)
+    {
+        return text[start] != '-' ?
+                   throw std::invalid_argument("Default arguments: value without option.") :
+               (end - start < 2 || text[start + 1] == '-') ?
+                   throw std::invalid_argument("Default arguments: option name expected.") :
+               contains_option(text, length, skip_spaces(text, length, end), text + start, end - start) ?
+                   throw std::invalid_argument("Default arguments: option is present multiple times.") :
+               check_value(text, length, skip_spaces(text, length, end),
+                           schema_length == 0 ? 0 : schema_kind(schema, schema_length, skip_spaces(schema, schema_length, 0),
+                                                                text + start + 1, end - start - 1),
+                           schema, schema_length);
+    }
+
+    // next is the start of the token after the option name, or length
+    static constexpr std::size_t check_value(char const * text, std::size_t length, std::size_t next, int kind,
+                                             char const * schema, std::size_t schema_length)
+    {
+        return (schema_length != 0 && kind == 0) ?
+                   throw std::invalid_argument("Default arguments: option is not in the schema.") :
+               (kind == 2 && (next == length || text[next] == '-')) ?
+                   throw std::invalid_argument("Default arguments: parameter without value.") :
+               (kind == 1 && next < length && text[next] != '-') ?
+                   throw std::invalid_argument("Default arguments: switch with value.") :
+               1 + count_options(text, length,
+                                 (next < length && text[next] != '-') ?
+                                     skip_spaces(text, length, token_end(text, length, next)) : next,
+                                 schema, schema_length);
+    }
+
+    char const * _text;
+    std::size_t _length;
+    std::size_t _size;
 };
 
 /**
@@ -80,10 +511,20 @@ public:
 
 	virtual ~ArgumentParser();
 
+    /*
+     * Copies get their own schema and parsed arguments.
+     */
+    ArgumentParser(ArgumentParser const & other);
+    ArgumentParser & operator=(ArgumentParser const & other);
+
 
     /**
      * Parse command line arguments according to requested format.
      *
+     * With GNU_PARAM_SWITCH, parsed names and values are not copied: they
+     * point into argv, as getopt_long()'s optarg does, so argv must stay
+     * alive and unchanged until the next parse(). Other formats copy them.
+     *
      * @param argc
      * @param argv
      * @param format Command-line arguments format.
@@ -92,6 +533,130 @@ public:
      */
 	bool parse(int argc, char* argv[], ArgumentFormat format = PARAM_SWITCH);
 
+    /**
+     * Declares an option that does not take a value. Declarations are only
+     * used by the GNU_PARAM_SWITCH format.
+     *
+     * @param name Option name, without leading dashes.
+     */
+    void declare_switch(std::string const & name);
+
+    /**
+     * Declares an option that requires a value. Declarations are only used
+     * by the GNU_PARAM_SWITCH format.
+     *
+     * @param name Option name, without leading dashes.
+     */
+    void declare_param(std::string const & name);
+
+    /**
+     * Makes this instance store option names as symbols of a table that
+     * can be shared with other instances, instead of keeping its own
+     * copies. Clears parsed arguments; call it before parse().
+     *
+     * @param symbols Symbol table, or null to go back to private names.
+     */
+    void set_symbol_table(std::shared_ptr<ArgumentSymbolTable> symbols);
+
+    /**
+     * Sets the value used for name when it is not given in the command
+     * line. Defaults are added after a successful parse(), so is_present()
+     * reports true for them.
+     *
+     * @param name Option name, without leading dashes.
+     * @param value Default value.
+     */
+    void set_default(std::string const & name, std::string const & value);
+
+    /**
+     * Sets an embedded default command line (see ArgumentDefaults),
+     * replacing any previous one. The text, already validated, is split
+     * here once. After each successful parse(), its options not given in
+     * the command line are added, before set_default() values, as pointers
+     * into the text: parse() neither scans nor copies it.
+     *
+     * @param defaults Validated default command line.
+     */
+    void set_defaults(ArgumentDefaults const & defaults);
+
+    /**
+     * Registers a command for the VERB_PARAM_SWITCH and GNU_PARAM_SWITCH
+     * formats. Commands can be nested by giving a path of words separated
+     * by single spaces ("db compact"); intermediate words become commands
+     * without a handler unless registered themselves.
+     *
+     * Once any command is registered, parse() consumes the longest
+     * sequence of leading arguments that forms a registered path, and
+     * get_verb() returns that path. Only then, the schemas along the path
+     * run, outermost first, so their declare_*() and set_default() calls
+     * apply to the rest of the command line. Options and defaults they add
+     * are discarded on the next parse(); declare options shared by all
+     * commands before the first parse().
+     *
+     * @param path Command path.
+     * @param handler Called by dispatch() when path is selected (optional).
+     * @param schema Declares the options of the command (optional).
+     */
+    void add_command(std::string const & path, CommandHandler handler, CommandSchema schema = nullptr);
+
+    /**
+     * Runs the handler of the command selected by the last parse().
+     *
+     * @param default_value Returned if no command with a handler was
+     *        selected, which is treated as a conversion error.
+     * @return Value returned by the handler.
+     */
+    int dispatch(int default_value = 0);
+
+    /**
+     * Lists declared option names starting with prefix, in sorted order.
+     * Intended for shell completion; runs in O(log n + k) over the
+     * declarations, once they have been sorted by the first call or
+     * parse() after the last declaration.
+     *
+     * @param prefix Partial option name, without leading dashes.
+     * @param limit Maximum number of names to return, 0 for no limit.
+     * @return Matching option names.
+     */
+    std::vector<std::string> complete(std::string const & prefix, std::size_t limit = 0) const;
+
+    /**
+     * Sets how parse() handles positional arguments. Note that in the
+     * PARAM_SWITCH and VERB_PARAM_SWITCH formats, an argument following a
+     * switch is taken as the switch's value; use "--" or GNU_PARAM_SWITCH
+     * with declared switches when that is ambiguous.
+     *
+     * @param policy (default = REJECT_POSITIONAL)
+     */
+    void set_positional_policy(PositionalPolicy policy);
+
+    /**
+     * Sets the checks parse() runs on all arguments before parsing them,
+     * e.g. so that values can be written to logs or JSON as is. ASCII text
+     * is checked eight bytes at a time.
+     *
+     * @param policy (default = ACCEPT_ANY_BYTES)
+     */
+    void set_validation_policy(ValidationPolicy policy);
+
+    /**
+     * Arguments that ended option processing and all that follow them (see
+     * PositionalPolicy), pointing into the argv array given to parse(),
+     * which must still be alive. No copies are made.
+     *
+     * @return Remaining arguments; argc is 0 if there are none.
+     */
+    ArgumentSpan get_remaining_arguments() const;
+
+    /**
+     * Positional arguments collected with the COLLECT_POSITIONAL policy,
+     * in order, pointing into the argv array given to parse(). Valid until
+     * the next parse().
+     *
+     * @return Positional arguments.
+     */
+    std::vector<char *> const & get_positional_arguments() const;
+
     /**
      *
      * @param name
@@ -125,6 +690,32 @@ public:
 	float         get_as_float         (std::string const & name, float default_value = 0.0);
 	double        get_as_double        (std::string const & name, double default_value = 0.0);
 
+    /**
+     * Reads a byte size such as "512MiB", "1.5G" or "4096". Accepts SI
+     * (k, M, G, T, P, E: powers of 1000) and IEC (Ki, Mi, Gi, Ti, Pi, Ei:
+     * powers of 1024) prefixes, optionally followed by 'B', in any case.
+     * Fractional values are truncated to whole bytes; values that do not
+     * fit in 64 bits are conversion errors.
+     *
+     * @param name
+     * @param default_value
+     * @return Number of bytes.
+     */
+    unsigned long long get_as_bytes(std::string const & name, unsigned long long default_value = 0);
+
+    /**
+     * Reads a duration such as "250ms", "1.5h" or "30". Accepts the units
+     * ns, us (or µs), ms, s, m (or min), h and d; values without unit are
+     * seconds. Fractional values are truncated to whole nanoseconds; values
+     * that do not fit are conversion errors.
+     *
+     * @param name
+     * @param default_value
+     * @return Duration.
+     */
+    std::chrono::nanoseconds get_as_duration(std::string const & name,
+        std::chrono::nanoseconds default_value = std::chrono::nanoseconds::zero());
+
     /**
      * Checks if the last conversion operation (any method starting with
      * get_*) had an error.
@@ -132,15 +723,149 @@ public:
      * @return true if last conversion operation  encountered an error.
      */
     bool error();
+
+    /**
+     * @return Description of the last conversion error, or of the last
+     *         parsing error if no conversion method was called after it.
+     */
     std::string get_error_message();
 
+    /**
+     * Declared option names closest to the unrecognized option that made
+     * the last parse() call fail, best match first. Suggestions are also
+     * appended to the error message. Only available for long options in
+     * the GNU_PARAM_SWITCH format.
+     *
+     * @return Up to three option names, or none.
+     */
+    std::vector<std::string> get_suggestions() const;
+
+    /**
+     * Serializes the parsed verb and arguments into a compact, relocatable
+     * binary blob. All offsets inside the blob are relative to its start,
+     * so it can be written to a file or POSIX shared memory and mapped at
+     * any address. Use ArgumentSnapshot to query it in place, or
+     * load_snapshot() to restore it into another ArgumentParser.
+     *
+     * The blob uses native byte order; it is meant to be shared between
+     * processes on the same host, not as a portable file format.
+     *
+     * @return Snapshot bytes.
+     */
+    std::vector<char> snapshot() const;
+
+    /**
+     * Replaces the current verb and arguments with the contents of a blob
+     * produced by snapshot(). Positional and remaining arguments, the
+     * selected command and its schema are cleared, as by parse(). An
+     * invalid blob is treated as a parsing failure, following the throw
+     * policy given on constructor.
+     *
+     * @param data Start of the snapshot.
+     * @param size Size of the snapshot, in bytes.
+     * @return true on success, false on failure.
+     */
+    bool load_snapshot(void const * data, std::size_t size);
+
+private:
+    enum OptionKind
+    {
+        OPTION_UNDECLARED,
+        OPTION_SWITCH,
+        OPTION_PARAM
+    };
+
+    struct OptionSpec
+    {
+        std::string name;
+        OptionKind kind;
+        std::size_t hash;
+    };
+
+    struct ScaledUnit
+    {
+        char const * suffix;
+        unsigned long long multiplier;
+    };
+
+    struct EmbeddedDefault
+    {
+        char const * name;  // Into the ArgumentDefaults text
+        std::size_t name_length;
+        std::size_t hash;
+        char const * value;
+        std::size_t value_length;
+    };
+
+    struct Command
+    {
+        std::string path;
+        CommandHandler handler;
+        CommandSchema schema;
+    };
+
+    // Declarations, defaults and commands, allocated by the first call that
+    // sets any of them: parsers that only parse do not pay for them
+    struct Schema
+    {
+        Schema();
+
+        std::vector<OptionSpec> option;          // Sorted by name, without duplicates, once option_sorted
+                                                 // (except for those appended by command schemas)
+        bool option_sorted;
+        std::vector<std::size_t> option_slot;    // Hash index into option (position + 1, or 0)
+        std::vector<unsigned char> short_option; // OptionKind by character
+        std::vector<std::pair<std::string, std::string>> default_argument;
+        std::vector<EmbeddedDefault> embedded_default;
+        std::vector<std::string> suggestion;     // From the last parse()
+
+        // Commands, and perfect hash index over their paths
+        std::vector<Command> command;
+        std::vector<std::size_t> command_displacement; // Seed by bucket
+        std::vector<std::size_t> command_slot;         // Position + 1, or 0
+
+        // The selected command's schemas append to the options and defaults;
+        // restore_schema() truncates them and undoes the index changes
+        bool command_schema_applied;
+        std::size_t base_option_count;
+        std::size_t base_default_count;
+        std::vector<std::pair<std::size_t, std::size_t>> option_slot_undo;      // Slot, previous value
+        bool option_slot_rebuilt;                                               // Undo log no longer applies
+        std::vector<std::pair<unsigned char, unsigned char>> short_option_undo; // Character, previous kind
+        bool base_embedded_default_saved;
+        std::vector<EmbeddedDefault> base_embedded_default;
+    };
+
 private:
     // Helper methods
     bool is_switch(std::string const & token) const;
+    void ensure_schema();
+    void declare(std::string const & name, OptionKind kind);
+    void sort_options() const;
+    void index_options();
+    std::size_t find_option_slot(char const * name, std::size_t length, std::size_t hash) const;
+    OptionSpec const * find_option(char const * name, std::size_t length, std::size_t hash) const;
+    std::vector<OptionSpec const *> find_option_prefix(char const * prefix, std::size_t length) const;
+    bool shadowed(OptionSpec const & option) const;
+    void index_commands();
+    std::size_t find_command(char const * path, std::size_t length) const;
+    bool select_command(int argc, char* argv[], int & current);
+    void restore_schema();
+    void apply_defaults();
+    bool parse_gnu(int current, int argc, char* argv[]);
+    void end_options(int first, int argc, char* argv[]);
+    bool parse_gnu_long_option(char const * token, int & current, int argc, char* argv[]);
+    bool parse_gnu_short_options(char const * token, int & current, int argc, char* argv[]);
+    bool store_argument(char const * token, char const * name, std::size_t length, std::size_t hash, char const * value,
+                        ArgumentTable::Storage storage);
     void handle_parse_error(std::string const & msg);
+    void suggest_options(char const * name, std::size_t length);
     void handle_conversion_error(std::string const & msg);
     std::string get_stripped_switch_name(std::string const & token) const;
+    bool validate_arguments(int argc, char* argv[]);
     bool parse_bool_value(std::string const & name, std::string const & value);
+    bool parse_scaled_value(std::string const & name, std::string const & value, ScaledUnit const * units,
+                            bool ignore_case, unsigned long long maximum, unsigned long long & result);
     bool case_independent_compare(std::string const & s1, std::string const & s2);
 
 private:
@@ -149,6 +874,70 @@ private:
     bool mutable _conversion_error;
 	bool _throw_on_parse_error;
 	bool _throw_on_conversion_error;
-	std::unordered_map<std::string, std::string> _argument;
+	ArgumentTable _argument;
+    ArgumentSpan _remaining;
+    PositionalPolicy _positional_policy;
+    ValidationPolicy _validation_policy;
+    std::vector<char *> _positional;
+    std::size_t _selected_command;   // Position + 1 in the schema's commands, or 0
+    std::unique_ptr<Schema> _schema; // Null until something is declared
+};
+
+/**
+ * Read-only view over a blob produced by ArgumentParser::snapshot().
+ *
+ * The view does not copy nor deserialize the blob; lookups binary search
+ * the sorted index stored in it and return pointers into the blob, so
+ * the blob must outlive the view. All returned strings are NUL-terminated.
+ */
+class ArgumentSnapshot
+{
+public:
+
+    /**
+     * @param data Start of the snapshot (any alignment).
+     * @param size Size of the snapshot, in bytes.
+     */
+    ArgumentSnapshot(void const * data, std::size_t size);
+
+    /**
+     * @return true if the blob is a well-formed snapshot. All other methods
+     *         behave as if the snapshot were empty when this is false.
+     */
+    bool valid() const;
+
+    /**
+     * @return Number of arguments (not counting the verb) in the snapshot.
+     */
+    std::size_t size() const;
+
+    /**
+     * @param name
+     * @return true if name is an argument or the verb.
+     */
+    bool is_present(char const * name) const;
+
+    /**
+     * @return Verb, or an empty string if there is none.
+     */
+    char const * get_verb() const;
+
+    /**
+     * @param name
+     * @return Value of the argument, or nullptr if not present. Switches
+     *         without value return an empty string.
+     */
+    char const * get(char const * name) const;
+
+private:
+    std::uint32_t read_u32(std::size_t offset) const;
+    bool check_string(std::uint32_t offset, std::uint32_t length) const;
+    char const * find(char const * name) const;
+
+private:
+    char const * _data;
+    std::size_t _size;
+    std::uint32_t _count;
+    bool _valid;
 };
 
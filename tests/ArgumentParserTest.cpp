@@ -139,6 +139,332 @@ void ArgumentParserTest::test_parse_ps()
     CPPUNIT_ASSERT_THROW_MESSAGE("Case 14", create_and_parse_and_check("tool -option value1 -option value2", ArgumentFormat::PARAM_SWITCH, true), std::invalid_argument);
 }
 
+void ArgumentParserTest::test_parse_gnu()
+{
+    // Correct cases / No schema
+    CPPUNIT_ASSERT_MESSAGE("Case 1", create_and_parse_and_check("tool", ArgumentFormat::GNU_PARAM_SWITCH, false));
+    CPPUNIT_ASSERT_MESSAGE("Case 2", create_and_parse_and_check("tool -abc --name=value --option value --switch", ArgumentFormat::GNU_PARAM_SWITCH, false));
+    CPPUNIT_ASSERT_MESSAGE("Case 3", create_and_parse_and_check("tool --switch -- value1 -value2", ArgumentFormat::GNU_PARAM_SWITCH, false));
+
+    // Incorrect cases / No schema
+    CPPUNIT_ASSERT_MESSAGE("Case 4", !create_and_parse_and_check("tool value", ArgumentFormat::GNU_PARAM_SWITCH, false));
+    CPPUNIT_ASSERT_MESSAGE("Case 5", !create_and_parse_and_check("tool -a value", ArgumentFormat::GNU_PARAM_SWITCH, false));
+    CPPUNIT_ASSERT_MESSAGE("Case 6", !create_and_parse_and_check("tool -aba", ArgumentFormat::GNU_PARAM_SWITCH, false));
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 7", create_and_parse_and_check("tool --=value", ArgumentFormat::GNU_PARAM_SWITCH, true), std::invalid_argument);
+
+    // Declared schema
+    int argc;
+    char ** argv = split_arguments("tool -vj8 -o out --level=3 --name first --quiet -- child -x", argc);
+
+    ArgumentParser ap(false);
+    ap.declare_switch("v");
+    ap.declare_switch("quiet");
+    ap.declare_param("j");
+    ap.declare_param("o");
+    ap.declare_param("level");
+    ap.declare_param("name");
+    CPPUNIT_ASSERT_MESSAGE("Case 8:1", ap.parse(argc, argv, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 8:2", ap.is_present("v"));
+    CPPUNIT_ASSERT_MESSAGE("Case 8:3", ap.get_as_int("j") == 8);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:4", ap.get_as_string("o").compare("out") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:5", ap.get_as_int("level") == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:6", ap.get_as_string("name").compare("first") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:7", ap.is_present("quiet"));
+    CPPUNIT_ASSERT_MESSAGE("Case 8:8", !ap.is_present("x"));
+
+    auto remaining = ap.get_remaining_arguments();
+    CPPUNIT_ASSERT_MESSAGE("Case 8:9", remaining.argc == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:10", remaining.argv == argv + argc - 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:11", std::strcmp(remaining.argv[0], "child") == 0);
+
+    // Declared values may look like options
+    char * dash_value[] = { argv[0], const_cast<char *>("--name"), const_cast<char *>("-x") };
+    CPPUNIT_ASSERT_MESSAGE("Case 9:1", ap.parse(3, dash_value, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:2", ap.get_as_string("name").compare("-x") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:3", ap.get_remaining_arguments().argc == 0);
+
+    // Schema violations
+    char * unknown[] = { argv[0], const_cast<char *>("--unknown") };
+    char * unknown_short[] = { argv[0], const_cast<char *>("-vx") };
+    char * switch_value[] = { argv[0], const_cast<char *>("--quiet=yes") };
+    char * missing_value[] = { argv[0], const_cast<char *>("-vj") };
+    CPPUNIT_ASSERT_MESSAGE("Case 10:1", !ap.parse(2, unknown, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 10:2", !ap.parse(2, unknown_short, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 10:3", !ap.parse(2, switch_value, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 10:4", !ap.parse(2, missing_value, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 10:5", !ap.is_present("v"));
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+}
+
+void ArgumentParserTest::test_parse_gnu_abbreviation()
+{
+    ArgumentParser ap(false);
+    ap.declare_switch("verbose");
+    ap.declare_switch("version");
+    ap.declare_param("level");
+    ap.declare_param("levels");
+    ap.declare_param("output");
+    ap.declare_switch("o");
+
+    // Completion
+    auto names = ap.complete("ver");
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", names.size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", names[0].compare("verbose") == 0 && names[1].compare("version") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", ap.complete("o").size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", ap.complete("level").size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", ap.complete("").size() == 6);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", ap.complete("", 4).size() == 4);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:7", ap.complete("x").empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 1:8", ap.complete("verbosee").empty());
+
+    // Unique prefixes resolve to the full name; exact names win over prefixes
+    char tool[] = "tool";
+    char verb[] = "--verb";
+    char level[] = "--level=3";
+    char out[] = "--out";
+    char file[] = "file";
+    char * abbreviated[] = { tool, verb, level, out, file };
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", ap.parse(5, abbreviated, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", ap.is_present("verbose"));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", !ap.is_present("verb"));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:4", ap.get_as_int("level") == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:5", !ap.is_present("levels"));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:6", ap.get_as_string("output").compare("file") == 0);
+
+    // Expanded names are copied, so later declarations do not affect them
+    for(int i = 0; i < 64; ++i) {
+        ap.declare_switch("extra" + std::to_string(i));
+    }
+    CPPUNIT_ASSERT_MESSAGE("Case 2:7", ap.is_present("verbose"));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:8", ap.get_as_string("output").compare("file") == 0);
+
+    // Ambiguous or repeated through abbreviation
+    char ver[] = "--ver";
+    char verbose[] = "--verbose";
+    char * ambiguous[] = { tool, ver };
+    char * repeated[] = { tool, verb, verbose };
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", !ap.parse(2, ambiguous, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", !ap.parse(3, repeated, ArgumentFormat::GNU_PARAM_SWITCH));
+
+    ArgumentParser throwing(true);
+    throwing.declare_switch("verbose");
+    throwing.declare_switch("version");
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 3:3", throwing.parse(2, ambiguous, ArgumentFormat::GNU_PARAM_SWITCH), std::invalid_argument);
+
+    // Redeclaring an option replaces it, in any declaration order
+    char mode[] = "--mode";
+    char fast[] = "fast";
+    char * redeclared[] = { tool, mode, fast };
+    ArgumentParser last(false);
+    for(int i = 999; i >= 0; --i) {
+        last.declare_switch("option" + std::to_string(i));
+    }
+    last.declare_switch("mode");
+    last.declare_switch("option7");
+    last.declare_param("mode");
+    CPPUNIT_ASSERT_MESSAGE("Case 4:1", last.complete("").size() == 1001);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:2", last.complete("option99").size() == 11);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:3", last.parse(3, redeclared, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 4:4", last.get_as_string("mode").compare("fast") == 0);
+    last.declare_switch("mode");
+    CPPUNIT_ASSERT_MESSAGE("Case 4:5", !last.parse(3, redeclared, ArgumentFormat::GNU_PARAM_SWITCH));
+}
+
+void ArgumentParserTest::test_parse_gnu_suggestions()
+{
+    ArgumentParser ap(false);
+    ap.declare_switch("verbose");
+    ap.declare_switch("version");
+    ap.declare_param("timeout");
+    ap.declare_param("threads");
+    ap.declare_param("output");
+
+    char tool[] = "tool";
+    char transposed[] = "--vrebose";
+    char missing[] = "--tmeout=5";
+    char unrelated[] = "--zzz";
+    char * typo[] = { tool, transposed };
+
+    // Closest names first, reported with the parse error
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", !ap.parse(2, typo, ArgumentFormat::GNU_PARAM_SWITCH));
+    auto suggestions = ap.get_suggestions();
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", !suggestions.empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", suggestions[0].compare("verbose") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", ap.get_error_message().find("Did you mean '--verbose'") != std::string::npos);
+
+    typo[1] = missing;
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", !ap.parse(2, typo, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", ap.get_suggestions().size() == 1);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", ap.get_suggestions()[0].compare("timeout") == 0);
+
+    // Nothing close enough
+    typo[1] = unrelated;
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", !ap.parse(2, typo, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", ap.get_suggestions().empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 3:3", !ap.get_error_message().empty());
+
+    // Cleared on success
+    char * valid[] = { tool };
+    CPPUNIT_ASSERT_MESSAGE("Case 4:1", ap.parse(1, valid, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 4:2", ap.get_suggestions().empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 4:3", ap.get_error_message().empty());
+
+    // Suggestions are part of the exception message
+    ArgumentParser throwing(true);
+    throwing.declare_switch("verbose");
+    typo[1] = transposed;
+    try {
+        throwing.parse(2, typo, ArgumentFormat::GNU_PARAM_SWITCH);
+        CPPUNIT_ASSERT_MESSAGE("Case 5:1", false);
+    } catch(std::invalid_argument const & ex) {
+        CPPUNIT_ASSERT_MESSAGE("Case 5:2", std::string(ex.what()).find("'--verbose'?") != std::string::npos);
+    }
+}
+
+void ArgumentParserTest::test_parse_positional()
+{
+    int argc;
+    char ** argv = split_arguments("tool -level 3 input1 -switch -- input2 -x", argc);
+
+    // Collected wherever they appear, including after the terminator
+    ArgumentParser ap(false);
+    ap.set_positional_policy(COLLECT_POSITIONAL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap.parse(argc, argv, ArgumentFormat::PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap.get_as_int("level") == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", ap.is_present("switch"));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", !ap.is_present("x"));
+    auto const & positional = ap.get_positional_arguments();
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", positional.size() == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", positional[0] == argv[3] && positional[1] == argv[6] && positional[2] == argv[7]);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:7", ap.get_remaining_arguments().argv == argv + 6);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:8", ap.get_remaining_arguments().argc == 2);
+
+    // First positional ends option processing; tail is passed through untouched
+    ap.set_positional_policy(STOP_AT_POSITIONAL);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", ap.parse(argc, argv, ArgumentFormat::PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", ap.get_as_int("level") == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", !ap.is_present("switch"));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:4", ap.get_positional_arguments().empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 2:5", ap.get_remaining_arguments().argv == argv + 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:6", ap.get_remaining_arguments().argc == 5);
+
+    char tool[] = "tool";
+    char level[] = "--level=3";
+    char child[] = "child";
+    char child_switch[] = "-x";
+    char * gnu[] = { tool, level, child, child_switch, nullptr };
+    CPPUNIT_ASSERT_MESSAGE("Case 2:7", ap.parse(4, gnu, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:8", ap.get_as_int("level") == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:9", ap.get_remaining_arguments().argv == gnu + 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:10", ap.get_remaining_arguments().argc == 2);
+
+    // Verb format, terminator right after the verb
+    char verb[] = "run";
+    char terminator[] = "--";
+    char * wrapped[] = { tool, verb, terminator, child, nullptr };
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", ap.parse(4, wrapped, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", ap.get_verb().compare("run") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:3", ap.get_remaining_arguments().argc == 1);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:4", ap.get_remaining_arguments().argv[0] == child);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:5", ap.get_remaining_arguments().argv[1] == nullptr);
+
+    // Verb format, no verb: a leading terminator is not taken for a switch
+    char * verbless[] = { tool, terminator, child, child_switch, nullptr };
+    CPPUNIT_ASSERT_MESSAGE("Case 3:6", ap.parse(4, verbless, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:7", ap.get_verb().empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 3:8", ap.get_remaining_arguments().argv == verbless + 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:9", ap.get_remaining_arguments().argc == 2);
+    ap.set_positional_policy(COLLECT_POSITIONAL);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:10", ap.parse(4, verbless, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:11", ap.get_positional_arguments().size() == 2);
+
+    // Default policy still rejects them
+    ArgumentParser strict(false);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:1", !strict.parse(argc, argv, ArgumentFormat::PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 4:2", strict.get_remaining_arguments().argc == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:3", !strict.parse(4, verbless, ArgumentFormat::VERB_PARAM_SWITCH));
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+}
+
+void ArgumentParserTest::test_parse_validation()
+{
+    int argc;
+    char ** valid = split_arguments("tool -name na\xC3\xAFve -city \xE6\x9D\xB1\xE4\xBA\xAC -icon \xF0\x9F\x98\x80 -long abcdefghijklmnopqrstuvwxyz0123456789_\xC3\xA9", argc);
+
+    ArgumentParser ap(false);
+    ap.set_validation_policy(REQUIRE_UTF8_NO_CONTROL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap.parse(argc, valid));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap.get_as_string("city") == "\xE6\x9D\xB1\xE4\xBA\xAC");
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] valid[i];
+    }
+    delete [] valid;
+
+    // Malformed UTF-8: overlong, surrogate, above U+10FFFF, truncated, stray continuation
+    char const * invalid[] = {
+        "tool -name \xC0\xAF",
+        "tool -name \xED\xA0\x80",
+        "tool -name \xF4\x90\x80\x80",
+        "tool -name abc\xE2\x82",
+        "tool -name abcdefghijklmnopqrstuvwxyz0123456789\x80"
+    };
+    for(auto cmd : invalid) {
+        char ** argv = split_arguments(cmd, argc);
+        ap.set_validation_policy(ACCEPT_ANY_BYTES);
+        CPPUNIT_ASSERT_MESSAGE("Case 2:1", ap.parse(argc, argv));
+        ap.set_validation_policy(REQUIRE_UTF8);
+        CPPUNIT_ASSERT_MESSAGE("Case 2:2", !ap.parse(argc, argv));
+        CPPUNIT_ASSERT_MESSAGE("Case 2:3", ap.get_error_message().find("Argument 2 is not valid UTF-8") == 0);
+        CPPUNIT_ASSERT_MESSAGE("Case 2:4", !ap.is_present("name"));
+
+        for(int i = 0; i < argc; ++i) {
+            delete [] argv[i];
+        }
+        delete [] argv;
+    }
+
+    // Control characters, C0, DEL and C1 (U+0085)
+    char const * control[] = {
+        "tool -name a\tb",
+        "tool -name 0123456789abcdef\x1B[0m",
+        "tool -name x\x7F",
+        "tool -name \xC2\x85"
+    };
+    for(auto cmd : control) {
+        char ** argv = split_arguments(cmd, argc);
+        ap.set_validation_policy(REQUIRE_UTF8);
+        CPPUNIT_ASSERT_MESSAGE("Case 3:1", ap.parse(argc, argv));
+        ap.set_validation_policy(REQUIRE_UTF8_NO_CONTROL);
+        CPPUNIT_ASSERT_MESSAGE("Case 3:2", !ap.parse(argc, argv));
+        CPPUNIT_ASSERT_MESSAGE("Case 3:3", ap.get_error_message().find("contains a control character") != std::string::npos);
+
+        for(int i = 0; i < argc; ++i) {
+            delete [] argv[i];
+        }
+        delete [] argv;
+    }
+
+    // Reported through the parse error policy
+    ArgumentParser throwing(true);
+    throwing.set_validation_policy(REQUIRE_UTF8);
+    char ** argv = split_arguments("tool -name \xFF", argc);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:1", throwing.parse(argc, argv), std::invalid_argument);
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+}
+
 void ArgumentParserTest::test_get_verb()
 {
     // Correct
@@ -165,6 +491,245 @@ void ArgumentParserTest::test_get_verb()
     delete ap;
 }
 
+void ArgumentParserTest::test_commands()
+{
+    int schema_calls = 0;
+
+    ArgumentParser ap(false);
+    ap.add_command("db compact", [](ArgumentParser & p) { return p.get_as_int("level"); },
+        [&schema_calls](ArgumentParser & p) {
+            ++schema_calls;
+            p.declare_param("level");
+            p.set_default("level", "5");
+        });
+    ap.add_command("db", [](ArgumentParser &) { return -1; });
+    ap.add_command("serve", [](ArgumentParser &) { return -2; },
+        [](ArgumentParser & p) {
+            p.declare_param("port");
+            p.set_default("port", "80");
+        });
+    for(int i = 0; i < 500; ++i) {
+        ap.add_command("cmd" + std::to_string(i), [i](ArgumentParser &) { return i; });
+    }
+
+    // Nested path, with schema and defaults built only for it
+    int argc;
+    char ** argv = split_arguments("tool db compact --level 3", argc);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap.parse(argc, argv, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap.get_verb().compare("db compact") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", ap.dispatch() == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", schema_calls == 1);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", !ap.is_present("port"));
+
+    char tool[] = "tool";
+    char db[] = "db";
+    char compact[] = "compact";
+    char serve[] = "serve";
+    char level[] = "--level";
+    char three[] = "3";
+    char * defaulted[] = { tool, db, compact };
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", ap.parse(3, defaulted, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", ap.dispatch() == 5);
+
+    // Intermediate path with its own handler; child schema not built
+    char * parent[] = { tool, db };
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", ap.parse(2, parent, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", ap.dispatch() == -1);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:3", schema_calls == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:4", !ap.is_present("level"));
+
+    // Previous command schema is discarded
+    char * other[] = { tool, serve, level, three };
+    CPPUNIT_ASSERT_MESSAGE("Case 4:1", !ap.parse(4, other, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 4:2", ap.parse(2, other, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 4:3", ap.get_as_int("port") == 80);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:4", ap.dispatch() == -2);
+
+    // Every registered path is found
+    bool all_found = true;
+    for(int i = 0; i < 500; ++i) {
+        auto name = "cmd" + std::to_string(i);
+        char * single[] = { tool, &name[0] };
+        all_found = all_found && ap.parse(2, single, ArgumentFormat::VERB_PARAM_SWITCH) && ap.dispatch() == i;
+    }
+    CPPUNIT_ASSERT_MESSAGE("Case 5:1", all_found);
+
+    // Unknown commands and missing handlers
+    char unknown[] = "unknown";
+    char * not_registered[] = { tool, unknown };
+    char * not_child[] = { tool, serve, unknown };
+    CPPUNIT_ASSERT_MESSAGE("Case 6:1", !ap.parse(2, not_registered, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 6:2", !ap.parse(3, not_child, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 6:3", ap.parse(1, not_registered, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 6:4", ap.dispatch(7) == 7);
+    CPPUNIT_ASSERT_MESSAGE("Case 6:5", ap.error());
+
+    // A failed parse forgets the command it had selected
+    char x[] = "-x";
+    char y[] = "y";
+    char z[] = "z";
+    char * failed[] = { tool, serve, x, y, z };
+    CPPUNIT_ASSERT_MESSAGE("Case 7:1", !ap.parse(5, failed, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 7:2", ap.dispatch(-99) == -99);
+    CPPUNIT_ASSERT_MESSAGE("Case 7:3", ap.error());
+
+    // Loading a snapshot forgets the command and positional arguments too
+    char dashes[] = "--";
+    char * selected[] = { tool, serve, dashes, y, z, nullptr };
+    ap.set_positional_policy(PositionalPolicy::COLLECT_POSITIONAL);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:1", ap.parse(5, selected, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 8:2", ap.get_positional_arguments().size() == 2);
+    ArgumentParser plain;
+    CPPUNIT_ASSERT_MESSAGE("Case 8:3", plain.parse(1, selected));
+    auto blob = plain.snapshot();
+    CPPUNIT_ASSERT_MESSAGE("Case 8:4", ap.load_snapshot(blob.data(), blob.size()));
+    CPPUNIT_ASSERT_MESSAGE("Case 8:5", ap.dispatch(-99) == -99);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:6", ap.get_positional_arguments().empty());
+    CPPUNIT_ASSERT_MESSAGE("Case 8:7", ap.get_remaining_arguments().argc == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 8:8", !ap.is_present("port"));
+
+    // Command declarations are layered over the shared ones, then undone
+    ArgumentParser layered(false);
+    layered.declare_switch("verbose");
+    layered.declare_param("value");
+    layered.set_default("value", "0");
+    layered.add_command("run", nullptr,
+        [](ArgumentParser & p) {
+            p.declare_param("verbose");
+            p.declare_switch("valid");
+            p.declare_switch("v");
+            p.set_default("value", "1");
+            p.set_default("extra", "x");
+        });
+    layered.add_command("big", nullptr,
+        [](ArgumentParser & p) {
+            for(int i = 0; i < 40; ++i) {
+                p.declare_switch("big" + std::to_string(i));
+            }
+        });
+    layered.add_command("other", nullptr);
+    char run[] = "run";
+    char big[] = "big";
+    char other_command[] = "other";
+    char verbose[] = "--verbose";
+    char two[] = "2";
+    char vali[] = "--vali";
+    char va[] = "--va";
+    char short_v[] = "-v";
+    char big39[] = "--big39";
+    char * layered_run[] = { tool, run, verbose, two, vali, short_v, nullptr };
+    char * layered_ambiguous[] = { tool, run, va, nullptr };
+    char * layered_other[] = { tool, other_command, verbose, nullptr };
+    char * layered_valid[] = { tool, other_command, vali, nullptr };
+    char * layered_big[] = { tool, big, big39, nullptr };
+    CPPUNIT_ASSERT_MESSAGE("Case 9:1", layered.parse(6, layered_run, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:2", layered.get_as_int("verbose") == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:3", layered.is_present("valid") && layered.is_present("v"));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:4", layered.get_as_int("value") == 1);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:5", layered.get_as_string("extra").compare("x") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:6", layered.complete("v").size() == 4);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:7", !layered.parse(3, layered_ambiguous, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:8", layered.parse(3, layered_other, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:9", layered.is_present("verbose") && layered.get_as_int("value") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:10", !layered.is_present("extra"));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:11", layered.complete("v").size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 9:12", !layered.parse(3, layered_valid, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:13", layered.parse(3, layered_big, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:14", layered.is_present("big39"));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:15", layered.parse(6, layered_run, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:16", layered.parse(3, layered_other, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 9:17", layered.complete("").size() == 2);
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+}
+
+void ArgumentParserTest::test_embedded_defaults()
+{
+    constexpr ArgumentDefaults profile("-cache 512MiB -timeout 250ms\n-verbose", "cache= timeout= verbose level=");
+    static_assert(profile.size() == 3, "Embedded defaults are counted at compile time");
+
+    int argc;
+    char ** argv = split_arguments("tool -timeout 1s -level 2", argc);
+
+    // Command line wins, embedded defaults win over set_default()
+    ArgumentParser ap(true, true);
+    ap.set_defaults(profile);
+    ap.set_default("cache", "1GiB");
+    ap.set_default("retries", "3");
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap.parse(argc, argv));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap.get_as_duration("timeout") == std::chrono::seconds(1));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", ap.get_as_bytes("cache") == 512ULL << 20);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", ap.is_present("verbose"));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", ap.get_as_int("level") == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", ap.get_as_int("retries") == 3);
+
+    // Also merged in GNU format
+    int gnu_argc;
+    char ** gnu = split_arguments("tool --cache=2G", gnu_argc);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", ap.parse(gnu_argc, gnu, ArgumentFormat::GNU_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", ap.get_as_string("cache") == "2G");
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", ap.get_as_string("timeout") == "250ms");
+
+    // Not merged after a failed parse
+    int bad_argc;
+    char ** bad = split_arguments("tool value", bad_argc);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 3:1", ap.parse(bad_argc, bad), std::invalid_argument);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", !ap.is_present("cache"));
+
+    // Outside constant expressions, malformed defaults throw
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:1", ArgumentDefaults("-cache 1 2"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:2", ArgumentDefaults("--cache 1"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:3", ArgumentDefaults("-cache", "cache="), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:4", ArgumentDefaults("-verbose 1", "cache= verbose"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:5", ArgumentDefaults("-size 1", "cache= verbose"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:6", ArgumentDefaults("-cache 1 -verbose -cache 2"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 4:7", ArgumentDefaults("-verbose -verbose"), std::invalid_argument);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:8", ArgumentDefaults("-cache cache -cachex 1").size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 4:9", ArgumentDefaults("").size() == 0);
+
+    // Token length does not count against the constexpr depth limit
+    constexpr ArgumentDefaults long_value("-path "
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     " -verbose", "path= verbose");
+    static_assert(long_value.size() == 2, "Long values fit in a constant expression");
+    ArgumentParser long_ap;
+    long_ap.set_defaults(long_value);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:1", long_ap.parse(1, argv));
+    CPPUNIT_ASSERT_MESSAGE("Case 5:2", long_ap.get_as_string("path").size() == 16 * 63);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:3", long_ap.is_present("verbose"));
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+    for(int i = 0; i < gnu_argc; ++i) {
+        delete [] gnu[i];
+    }
+    delete [] gnu;
+    for(int i = 0; i < bad_argc; ++i) {
+        delete [] bad[i];
+    }
+    delete [] bad;
+}
+
 void ArgumentParserTest::test_get_string()
 {
     // Correct
@@ -255,3 +820,242 @@ void ArgumentParserTest::test_get_double()
 
 }
 
+
+void ArgumentParserTest::test_get_bytes()
+{
+    // Correct
+    auto ap = create_and_parse("tool -b1 4096 -b2 512MiB -b3 1.5G -b4 2kb -b5 1KiB -b6 0.5ki -b7 16EiB -b8 18446744073709551615B -b9 1.001k -b10 0.1EiB", ArgumentFormat::PARAM_SWITCH, true);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap->get_as_bytes("b1") == 4096ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap->get_as_bytes("b2") == 512ULL * 1024 * 1024);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", ap->get_as_bytes("b3") == 1500000000ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", ap->get_as_bytes("b4") == 2000ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", ap->get_as_bytes("b5") == 1024ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", ap->get_as_bytes("b6") == 512ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:7", ap->get_as_bytes("b8") == 18446744073709551615ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:8", ap->get_as_bytes("bx", 64) == 64ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:9", ap->get_as_bytes("b9") == 1001ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:10", ap->get_as_bytes("b10") == (1ULL << 60) / 10);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:11", !ap->error());
+
+    // Incorrect + throw
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:1", ap->get_as_bytes("b7"), std::invalid_argument);
+    delete ap;
+
+    ap = create_and_parse("tool -b1 12XB -b2 MiB -b3 . -b4 1.2.3 -b5 18446744073709551616", ArgumentFormat::PARAM_SWITCH, true);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:2", ap->get_as_bytes("b1"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:3", ap->get_as_bytes("b2"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:4", ap->get_as_bytes("b3"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:5", ap->get_as_bytes("b4"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:6", ap->get_as_bytes("b5"), std::invalid_argument);
+    delete ap;
+
+    // Incorrect, no throw
+    ap = create_and_parse("tool -b1 +3k", ArgumentFormat::PARAM_SWITCH, false);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", ap->get_as_bytes("b1", 7) == 7ULL);
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", ap->error());
+    delete ap;
+}
+
+void ArgumentParserTest::test_get_duration()
+{
+    using std::chrono::nanoseconds;
+
+    // Correct
+    auto ap = create_and_parse("tool -d1 250ms -d2 1.5h -d3 30 -d4 10us -d5 2min -d6 1d -d7 0.000000001s -d8 3m -d9 0.001s", ArgumentFormat::PARAM_SWITCH, true);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap->get_as_duration("d1") == std::chrono::milliseconds(250));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap->get_as_duration("d2") == std::chrono::minutes(90));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", ap->get_as_duration("d3") == std::chrono::seconds(30));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", ap->get_as_duration("d4") == std::chrono::microseconds(10));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", ap->get_as_duration("d5") == std::chrono::minutes(2));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", ap->get_as_duration("d6") == std::chrono::hours(24));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:7", ap->get_as_duration("d7") == nanoseconds(1));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:8", ap->get_as_duration("d8") == std::chrono::minutes(3));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:9", ap->get_as_duration("dx", std::chrono::seconds(5)) == std::chrono::seconds(5));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:10", ap->get_as_duration("d9") == nanoseconds(1000000));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:11", !ap->error());
+    delete ap;
+
+    // Incorrect + throw
+    ap = create_and_parse("tool -d1 5MS -d2 1y -d3 ms -d4 200000d", ArgumentFormat::PARAM_SWITCH, true);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:1", ap->get_as_duration("d1"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:2", ap->get_as_duration("d2"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:3", ap->get_as_duration("d3"), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 2:4", ap->get_as_duration("d4"), std::invalid_argument);
+    delete ap;
+}
+
+void ArgumentParserTest::test_snapshot()
+{
+    // Round trip through a mapped view
+    auto ap = create_and_parse("tool verb -count 12 -name test -switch", ArgumentFormat::VERB_PARAM_SWITCH, false);
+    auto blob = ap->snapshot();
+    delete ap;
+
+    ArgumentSnapshot view(blob.data(), blob.size());
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", view.valid());
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", view.size() == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", std::strcmp(view.get_verb(), "verb") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", std::strcmp(view.get("count"), "12") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", std::strcmp(view.get("name"), "test") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", std::strcmp(view.get("switch"), "") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:7", view.get("missing") == nullptr);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:8", view.is_present("verb"));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:9", !view.is_present("countx"));
+
+    // Relocated copy restored into a parser
+    std::vector<char> moved(blob.size() + 1);
+    std::memcpy(moved.data() + 1, blob.data(), blob.size());
+    ArgumentParser restored;
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", restored.load_snapshot(moved.data() + 1, blob.size()));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", restored.get_verb().compare("verb") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", restored.get_as_int("count") == 12);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:4", restored.is_present("switch"));
+
+    // Truncated / corrupted
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", !ArgumentSnapshot(blob.data(), blob.size() / 2).valid());
+    blob[0] = 'X';
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", !ArgumentSnapshot(blob.data(), blob.size()).valid());
+    CPPUNIT_ASSERT_MESSAGE("Case 3:3", !restored.load_snapshot(blob.data(), blob.size()));
+    CPPUNIT_ASSERT_MESSAGE("Case 3:4", !restored.is_present("count"));
+
+    ArgumentParser throwing(true);
+    CPPUNIT_ASSERT_THROW_MESSAGE("Case 3:5", throwing.load_snapshot(blob.data(), blob.size()), std::invalid_argument);
+}
+
+void ArgumentParserTest::test_symbol_table()
+{
+    auto symbols = std::make_shared<ArgumentSymbolTable>();
+
+    int argc;
+    char ** argv = split_arguments("tool verb -count 12 -name test -switch", argc);
+
+    // Instances sharing a table intern each name once
+    ArgumentParser ap1(false);
+    ArgumentParser ap2(false);
+    ap1.set_symbol_table(symbols);
+    ap2.set_symbol_table(symbols);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", ap1.parse(argc, argv, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", ap2.parse(argc, argv, ArgumentFormat::VERB_PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", symbols->size() == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", ap1.get_as_int("count") == 12);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", ap2.get_as_string("name").compare("test") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", ap2.is_present("switch"));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:7", ap2.is_present("verb"));
+
+    // Lookups of unknown names do not grow the table
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", !ap1.is_present("missing"));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", ap1.get_as_string("missing", "default").compare("default") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", symbols->size() == 3);
+
+    std::uint32_t symbol;
+    CPPUNIT_ASSERT_MESSAGE("Case 2:4", symbols->find("count", 5, symbol));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:5", symbols->name(symbol).compare("count") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:6", symbols->intern("count") == symbol);
+
+    // Names are recovered through the table
+    auto blob = ap1.snapshot();
+    ArgumentSnapshot snapshot(blob.data(), blob.size());
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", snapshot.valid());
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", std::strcmp(snapshot.get("count"), "12") == 0);
+
+    // Duplicates still detected by symbol
+    char tool[] = "tool";
+    char count[] = "-count";
+    char * repeated[] = { tool, count, count };
+    CPPUNIT_ASSERT_MESSAGE("Case 4:1", !ap1.parse(3, repeated, ArgumentFormat::PARAM_SWITCH));
+
+    // Frozen table seeded from a schema; other names are kept privately
+    ArgumentParser schema;
+    schema.declare_param("level");
+    schema.declare_switch("v");
+    auto frozen = std::make_shared<ArgumentSymbolTable>();
+    frozen->intern_declared(schema);
+    frozen->freeze();
+    CPPUNIT_ASSERT_MESSAGE("Case 5:1", frozen->frozen() && frozen->size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:2", frozen->intern("other") == ArgumentSymbolTable::no_symbol);
+
+    char level[] = "-level";
+    char three[] = "3";
+    char v[] = "-v";
+    char other[] = "-other";
+    char x[] = "x";
+    char * mixed[] = { tool, level, three, v, other, x, other };
+    ArgumentParser ap3(false);
+    ap3.set_symbol_table(frozen);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:3", ap3.parse(6, mixed, ArgumentFormat::PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 5:4", frozen->size() == 2);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:5", ap3.get_as_int("level") == 3);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:6", ap3.is_present("v"));
+    CPPUNIT_ASSERT_MESSAGE("Case 5:7", ap3.get_as_string("other").compare("x") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:8", !ap3.is_present("missing"));
+    auto frozen_blob = ap3.snapshot();
+    ArgumentSnapshot frozen_snapshot(frozen_blob.data(), frozen_blob.size());
+    CPPUNIT_ASSERT_MESSAGE("Case 5:9", std::strcmp(frozen_snapshot.get("other"), "x") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 5:10", std::strcmp(frozen_snapshot.get("level"), "3") == 0);
+
+    // Duplicates detected for private names too
+    CPPUNIT_ASSERT_MESSAGE("Case 5:11", !ap3.parse(7, mixed, ArgumentFormat::PARAM_SWITCH));
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+}
+
+void ArgumentParserTest::test_copy()
+{
+    // Copies own their strings; the original can go away
+    std::string long_value(600, 'v');
+    std::string cmd = "tool -name value -switch -long " + long_value;
+    auto ap = create_and_parse(cmd.c_str(), ArgumentFormat::PARAM_SWITCH, false);
+    ArgumentParser copied(*ap);
+    ArgumentParser assigned;
+    assigned = *ap;
+    delete ap;
+    CPPUNIT_ASSERT_MESSAGE("Case 1:1", copied.get_as_string("name").compare("value") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:2", copied.get_as_string("long") == long_value);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:3", copied.is_present("switch"));
+    CPPUNIT_ASSERT_MESSAGE("Case 1:4", assigned.get_as_string("name").compare("value") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:5", assigned.get_as_string("long") == long_value);
+    CPPUNIT_ASSERT_MESSAGE("Case 1:6", assigned.is_present("switch"));
+
+    // Self assignment, and parsing again into a copy
+    assigned = assigned;
+    CPPUNIT_ASSERT_MESSAGE("Case 2:1", assigned.get_as_string("name").compare("value") == 0);
+    int argc;
+    char ** argv = split_arguments("tool -name other -count 3", argc);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:2", copied.parse(argc, argv, ArgumentFormat::PARAM_SWITCH));
+    CPPUNIT_ASSERT_MESSAGE("Case 2:3", copied.get_as_string("name").compare("other") == 0);
+    CPPUNIT_ASSERT_MESSAGE("Case 2:4", assigned.get_as_string("name").compare("value") == 0);
+
+    // Expanded GNU abbreviations are copied; values stay borrowed from argv
+    int gnu_argc;
+    char ** gnu = split_arguments("tool --verb 2", gnu_argc);
+    auto gnu_ap = new ArgumentParser(false);
+    gnu_ap->declare_param("verbose");
+    CPPUNIT_ASSERT_MESSAGE("Case 3:1", gnu_ap->parse(gnu_argc, gnu, ArgumentFormat::GNU_PARAM_SWITCH));
+    ArgumentParser gnu_copy(*gnu_ap);
+    delete gnu_ap;
+    CPPUNIT_ASSERT_MESSAGE("Case 3:2", gnu_copy.get_as_int("verbose") == 2);
+
+    // Copies made before the pool grows still read back
+    std::string many = "tool";
+    for(int i = 0; i < 40; ++i) {
+        many += " -param" + std::to_string(i) + " value" + std::to_string(i);
+    }
+    auto many_ap = create_and_parse(many.c_str(), ArgumentFormat::PARAM_SWITCH, false);
+    ArgumentParser many_copy(*many_ap);
+    delete many_ap;
+    for(int i = 0; i < 40; ++i) {
+        CPPUNIT_ASSERT_MESSAGE("Case 4:1", many_copy.get_as_string("param" + std::to_string(i)) == "value" + std::to_string(i));
+    }
+
+    for(int i = 0; i < argc; ++i) {
+        delete [] argv[i];
+    }
+    delete [] argv;
+    for(int i = 0; i < gnu_argc; ++i) {
+        delete [] gnu[i];
+    }
+    delete [] gnu;
+}
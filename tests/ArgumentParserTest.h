@@ -14,7 +14,14 @@ class ArgumentParserTest : public CPPUNIT_NS::TestFixture {
 
     CPPUNIT_TEST(test_parse_vps);
     CPPUNIT_TEST(test_parse_ps);
+    CPPUNIT_TEST(test_parse_gnu);
+    CPPUNIT_TEST(test_parse_gnu_abbreviation);
+    CPPUNIT_TEST(test_parse_gnu_suggestions);
+    CPPUNIT_TEST(test_parse_positional);
+    CPPUNIT_TEST(test_parse_validation);
     CPPUNIT_TEST(test_get_verb);
+    CPPUNIT_TEST(test_commands);
+    CPPUNIT_TEST(test_embedded_defaults);
     CPPUNIT_TEST(test_get_string);
     CPPUNIT_TEST(test_get_bool);
     CPPUNIT_TEST(test_get_int);
@@ -23,6 +30,11 @@ class ArgumentParserTest : public CPPUNIT_NS::TestFixture {
     CPPUNIT_TEST(test_get_unsigned_long);
     CPPUNIT_TEST(test_get_float);
     CPPUNIT_TEST(test_get_double);
+    CPPUNIT_TEST(test_get_bytes);
+    CPPUNIT_TEST(test_get_duration);
+    CPPUNIT_TEST(test_snapshot);
+    CPPUNIT_TEST(test_symbol_table);
+    CPPUNIT_TEST(test_copy);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -36,7 +48,14 @@ private:
     // Unit tests
     void test_parse_vps();
     void test_parse_ps();
+    void test_parse_gnu();
+    void test_parse_gnu_abbreviation();
+    void test_parse_gnu_suggestions();
+    void test_parse_positional();
+    void test_parse_validation();
     void test_get_verb();
+    void test_commands();
+    void test_embedded_defaults();
     void test_get_string();
     void test_get_bool();
     void test_get_int();
@@ -45,6 +64,11 @@ private:
     void test_get_unsigned_long();
     void test_get_float();
     void test_get_double();
+    void test_get_bytes();
+    void test_get_duration();
+    void test_snapshot();
+    void test_symbol_table();
+    void test_copy();
 
     // Helper methods
     char ** split_arguments(char const * cmd, int & argc);
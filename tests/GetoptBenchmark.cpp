@@ -0,0 +1,127 @@
+/*
+ * Author:  Carlos J. Cela
+ *          https://github.com/cjcela/argument-parser
+ *
+ * License: MIT - See LICENSE file
+ */
+
+/*
+ * Compares GNU_PARAM_SWITCH parsing throughput against glibc getopt_long()
+ * on identical inputs. Build and run with 'make bench'.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <getopt.h>
+
+#include "../ArgumentParser.h"
+
+namespace
+{
+    char arg0[] = "tool";
+    char arg1[] = "-v";
+    char arg2[] = "-j8";
+    char arg3[] = "--name=value";
+    char arg4[] = "--level";
+    char arg5[] = "3";
+    char arg6[] = "-abc";
+    char arg7[] = "--output";
+    char arg8[] = "file";
+    char arg9[] = "--quiet";
+
+    char * input[] = { arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, nullptr };
+    int const input_count = 10;
+
+    struct option const long_options[] = {
+        { "name",   required_argument, nullptr, 'n' },
+        { "level",  required_argument, nullptr, 'l' },
+        { "output", required_argument, nullptr, 'o' },
+        { "quiet",  no_argument,       nullptr, 'q' },
+        { nullptr,  0,                 nullptr, 0 }
+    };
+
+    template <typename Function>
+    double seconds(Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long iterations = (argc > 1) ? std::atol(argv[1]) : 1000000;
+    std::size_t checksum = 0;
+
+    // getopt_long() reorders argv, so give it its own copy
+    char * getopt_input[input_count + 1];
+
+    auto getopt_time = seconds([&]() {
+        for(long i = 0; i < iterations; ++i) {
+            std::memcpy(getopt_input, input, sizeof(getopt_input));
+            optind = 0;
+            int option;
+            while((option = getopt_long(input_count, getopt_input, "vj:abc", long_options, nullptr)) != -1) {
+                checksum += option + (optarg != nullptr ? optarg[0] : 0);
+            }
+        }
+    });
+
+    // For reference: a getopt_long() client that also keeps values around
+    std::string values[256];
+    bool present[256];
+
+    auto getopt_store_time = seconds([&]() {
+        for(long i = 0; i < iterations; ++i) {
+            std::memcpy(getopt_input, input, sizeof(getopt_input));
+            std::fill(present, present + 256, false);
+            optind = 0;
+            int option;
+            while((option = getopt_long(input_count, getopt_input, "vj:abc", long_options, nullptr)) != -1) {
+                present[option & 0xff] = true;
+                values[option & 0xff] = (optarg != nullptr) ? optarg : "";
+            }
+            checksum += values['n'].size();
+        }
+    });
+
+    ArgumentParser ap;
+    ap.declare_switch("v");
+    ap.declare_switch("a");
+    ap.declare_switch("b");
+    ap.declare_switch("c");
+    ap.declare_param("j");
+    ap.declare_param("name");
+    ap.declare_param("level");
+    ap.declare_param("output");
+    ap.declare_switch("quiet");
+
+    auto parser_time = seconds([&]() {
+        for(long i = 0; i < iterations; ++i) {
+            checksum += ap.parse(input_count, input, ArgumentFormat::GNU_PARAM_SWITCH);
+        }
+    });
+
+    ap.set_validation_policy(REQUIRE_UTF8_NO_CONTROL);
+
+    auto validating_parser_time = seconds([&]() {
+        for(long i = 0; i < iterations; ++i) {
+            checksum += ap.parse(input_count, input, ArgumentFormat::GNU_PARAM_SWITCH);
+        }
+    });
+
+    auto tokens = static_cast<double>(iterations) * (input_count - 1);
+    std::cout << "getopt_long:              " << tokens / getopt_time / 1e6 << " Mtokens/s" << std::endl;
+    std::cout << "getopt_long, with values: " << tokens / getopt_store_time / 1e6 << " Mtokens/s" << std::endl;
+    std::cout << "GNU_PARAM_SWITCH:         " << tokens / parser_time / 1e6 << " Mtokens/s" << std::endl;
+    std::cout << "GNU_PARAM_SWITCH, UTF-8:  " << tokens / validating_parser_time / 1e6 << " Mtokens/s" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+
+    return 0;
+}